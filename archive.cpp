@@ -0,0 +1,715 @@
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <thread>
+#include "archive.hpp"
+#include "sink.hpp"
+#include "stats.hpp"
+#include "ooz.hpp"
+
+// ResourceArchive constructor
+ResourceArchive::ResourceArchive(const fs::path &path)
+{
+    try {
+        memoryMappedFile = new MemoryMappedFile(path);
+    }
+    catch (const std::exception &e) {
+        throw ResourceError("Failed to open " + path.string() + " for reading.");
+    }
+
+    try {
+        PhaseTimer timer(Phase::Parse, memoryMappedFile->size);
+
+        // Identify file using magic
+        if (memoryMappedFile->size >= 4 && memcmp(memoryMappedFile->memp, "IDCL", 4) == 0) {
+            type = ArchiveType::Resources;
+            parseResource();
+        }
+        else if (memoryMappedFile->size >= 4 && *reinterpret_cast<uint32_t*>(memoryMappedFile->memp) == 131121354) {
+            type = ArchiveType::Wad7;
+            parseWad7();
+        }
+        else if (memoryMappedFile->size >= 4 && memcmp(memoryMappedFile->memp, "ERAW", 4) == 0) {
+            type = ArchiveType::Raw;
+            parseRaw();
+        }
+        else {
+            throw ResourceError(path.filename().string() + " is not a valid .resources or .wad7 file.");
+        }
+    }
+    catch (...) {
+        delete memoryMappedFile;
+        throw;
+    }
+}
+
+// Open raw files written by --raw as a single archive, holding the entry of each one in the given order
+// Only their headers are read here, each file is mapped again while its entry is read
+ResourceArchive::ResourceArchive(const std::vector<fs::path> &rawPaths) : type(ArchiveType::Raw), memoryMappedFile(nullptr), rawPaths(rawPaths)
+{
+    for (const auto &path : rawPaths) {
+        ResourceArchive rawFile(path);
+
+        if (rawFile.type != ArchiveType::Raw)
+            throw ResourceError(path.string() + " is not a raw file.");
+
+        entryIndices.emplace(rawFile.entries[0].name, entries.size());
+        entries.push_back(rawFile.entries[0]);
+    }
+}
+
+// ResourceArchive destructor
+ResourceArchive::~ResourceArchive()
+{
+    delete memoryMappedFile;
+}
+
+// Throw if the given range lies outside of the mapped file
+static void checkBounds(const MemoryMappedFile *memoryMappedFile, uint64_t offset, uint64_t length)
+{
+    if (offset > memoryMappedFile->size || length > memoryMappedFile->size - offset)
+        throw ResourceError(fs::path(memoryMappedFile->filePath).filename().string() + " is truncated or corrupted.");
+}
+
+// Add parsed entry to the entry list and name lookup table
+void ResourceArchive::addEntry(ResourceEntry &&entry)
+{
+    checkBounds(memoryMappedFile, entry.offset, entry.zSize);
+    entryIndices.emplace(entry.name, entries.size());
+    entries.push_back(std::move(entry));
+}
+
+// Parse index of resources file
+void ResourceArchive::parseResource()
+{
+    // Read resource data
+    size_t memPosition = 4;
+    checkBounds(memoryMappedFile, 0, 36 + 72);
+
+    uint32_t version = memoryMappedFile->readUint32LE(memPosition);
+
+    if (version >= 0xD) {
+        memPosition = 36;
+    }
+    else {
+        memPosition = 32;
+    }
+
+    uint32_t fileCount = memoryMappedFile->readUint32LE(memPosition);
+    memPosition += 4;
+
+    uint32_t dummyCount = memoryMappedFile->readUint32LE(memPosition);
+    memPosition += 20;
+
+    // Get offsets
+    uint64_t namesOffset = memoryMappedFile->readUint64LE(memPosition);
+    memPosition += 8;
+
+    uint64_t infoOffset = memoryMappedFile->readUint64LE(memPosition);
+    memPosition += 8;
+
+    uint64_t dummyOffset = memoryMappedFile->readUint64LE(memPosition) + dummyCount * sizeof(dummyCount);
+
+    // Get filenames
+    memPosition = namesOffset;
+    checkBounds(memoryMappedFile, memPosition, 8);
+    uint64_t nameCount = memoryMappedFile->readUint64LE(memPosition);
+    checkBounds(memoryMappedFile, memPosition, nameCount * 8);
+
+    std::vector<std::string> names;
+    names.reserve(nameCount);
+
+    size_t currentPosition = memPosition;
+    uint64_t namesStart = namesOffset + nameCount * 8 + 8;
+
+    for (uint64_t i = 0; i < nameCount; i++) {
+        memPosition = currentPosition + i * 8;
+        uint64_t currentNameOffset = memoryMappedFile->readUint64LE(memPosition);
+        checkBounds(memoryMappedFile, namesStart, currentNameOffset);
+
+        const char *nameStart = reinterpret_cast<char*>(memoryMappedFile->memp) + namesStart + currentNameOffset;
+        size_t maxLength = memoryMappedFile->size - namesStart - currentNameOffset;
+        names.emplace_back(nameStart, strnlen(nameStart, maxLength));
+    }
+
+    // Get file info
+    memPosition = infoOffset;
+    checkBounds(memoryMappedFile, memPosition, static_cast<uint64_t>(fileCount) * 144);
+    entries.reserve(fileCount);
+
+    for (uint32_t i = 0; i < fileCount; i++) {
+        memPosition += 32;
+
+        uint64_t nameIdOffset = memoryMappedFile->readUint64LE(memPosition);
+        memPosition += 16;
+
+        ResourceEntry entry;
+        entry.offset = memoryMappedFile->readUint64LE(memPosition);
+        entry.zSize = memoryMappedFile->readUint64LE(memPosition);
+        entry.size = memoryMappedFile->readUint64LE(memPosition);
+        memPosition += 32;
+
+        entry.compressionMode = memoryMappedFile->readUint64LE(memPosition);
+        memPosition += 24;
+
+        // Get name from the name id table
+        size_t nameIdPosition = (nameIdOffset + 1) * 8 + dummyOffset;
+        checkBounds(memoryMappedFile, nameIdPosition, 8);
+        uint64_t nameId = memoryMappedFile->readUint64LE(nameIdPosition);
+
+        if (nameId >= names.size())
+            throw ResourceError(fs::path(memoryMappedFile->filePath).filename().string() + " is truncated or corrupted.");
+
+        entry.name = names[nameId];
+        addEntry(std::move(entry));
+    }
+}
+
+// Parse index of WAD7 file
+void ResourceArchive::parseWad7()
+{
+    size_t memPosition = 19;
+    checkBounds(memoryMappedFile, memPosition, 16);
+
+    // Get index position and size
+    uint64_t indexStart = memoryMappedFile->readUint64BE(memPosition);
+    uint64_t indexSize = memoryMappedFile->readUint64BE(memPosition);
+    checkBounds(memoryMappedFile, indexStart, indexSize);
+
+    // Get entry count
+    memPosition = indexStart;
+    checkBounds(memoryMappedFile, memPosition, 4);
+    uint32_t entryCount = memoryMappedFile->readUint32BE(memPosition);
+    entries.reserve(entryCount);
+
+    for (uint32_t i = 0; i < entryCount; i++) {
+        // Get entry name
+        checkBounds(memoryMappedFile, memPosition, 4);
+        uint32_t nameSize = memoryMappedFile->readUint32LE(memPosition);
+        checkBounds(memoryMappedFile, memPosition, static_cast<uint64_t>(nameSize) + 32);
+
+        ResourceEntry entry;
+        entry.name.assign(reinterpret_cast<char*>(memoryMappedFile->memp) + memPosition, nameSize);
+        memPosition += nameSize;
+
+        // Get data offset, sizes and compression mode
+        entry.offset = memoryMappedFile->readUint64BE(memPosition);
+        entry.size = memoryMappedFile->readUint32BE(memPosition);
+        entry.zSize = memoryMappedFile->readUint32BE(memPosition);
+        entry.compressionMode = memoryMappedFile->readUint32BE(memPosition);
+        memPosition += 12;
+
+        addEntry(std::move(entry));
+    }
+}
+
+// Parse header of a single file copied out verbatim by --raw, its data follows the name
+void ResourceArchive::parseRaw()
+{
+    size_t memPosition = 4;
+    checkBounds(memoryMappedFile, 0, RAW_HEADER_SIZE);
+
+    uint32_t version = memoryMappedFile->readUint32LE(memPosition);
+
+    if (version != RAW_VERSION)
+        throw ResourceError(fs::path(memoryMappedFile->filePath).filename().string() + " has unsupported raw version " + std::to_string(version) + ".");
+
+    ResourceEntry entry;
+    entry.size = memoryMappedFile->readUint64LE(memPosition);
+    entry.zSize = memoryMappedFile->readUint64LE(memPosition);
+    entry.compressionMode = memoryMappedFile->readUint64LE(memPosition);
+
+    uint32_t nameSize = memoryMappedFile->readUint32LE(memPosition);
+    checkBounds(memoryMappedFile, memPosition, nameSize);
+    entry.name.assign(reinterpret_cast<char*>(memoryMappedFile->memp) + memPosition, nameSize);
+    entry.offset = memPosition + nameSize;
+
+    addEntry(std::move(entry));
+}
+
+// Map the raw file holding an entry of an archive of raw files, checking it still holds that entry
+std::unique_ptr<ResourceArchive> ResourceArchive::openRawFile(const ResourceEntry &entry) const
+{
+    const fs::path &path = rawPaths[&entry - entries.data()];
+    std::unique_ptr<ResourceArchive> rawFile(new ResourceArchive(path));
+
+    if (rawFile->type != ArchiveType::Raw || rawFile->entries[0].name != entry.name || rawFile->entries[0].offset != entry.offset
+    || rawFile->entries[0].size != entry.size || rawFile->entries[0].zSize != entry.zSize || rawFile->entries[0].compressionMode != entry.compressionMode)
+        throw ResourceError(path.string() + " changed during extraction.");
+
+    return rawFile;
+}
+
+// Find entry by name, returns nullptr if it doesn't exist
+const ResourceEntry *ResourceArchive::findEntry(const std::string &name) const
+{
+    auto it = entryIndices.find(name);
+
+    if (it == entryIndices.end())
+        return nullptr;
+
+    return &entries[it->second];
+}
+
+// Decodes a Kraken stream one block at a time into a sliding output window
+//
+// Once the window fills up, it slides forward keeping the last historySize bytes of output for later
+// blocks to reference. In place, the window is part of the whole output buffer and just moves forward
+// through it, otherwise the kept output is moved back to the start of the window buffer.
+class KrakenStream {
+public:
+    KrakenStream(const unsigned char *src, uint64_t srcSize, uint64_t size, unsigned char *window, uint64_t windowSize, uint64_t historySize, bool inPlace)
+        : src(src), srcSize(srcSize), size(size), window(window), windowSize(windowSize), historySize(historySize), inPlace(inPlace), decoder(Kraken_Create()) {}
+
+    ~KrakenStream()
+    {
+        Kraken_Destroy(decoder);
+    }
+
+    KrakenStream(const KrakenStream&) = delete;
+    KrakenStream &operator=(const KrakenStream&) = delete;
+
+    bool finished() const
+    {
+        return decoded == size;
+    }
+
+    uint64_t decodedSize() const
+    {
+        return decoded;
+    }
+
+    // Whether output was dropped from the window, so a failure may be a reference past it
+    bool slid() const
+    {
+        return windowSlid;
+    }
+
+    // Decode the next block, returns nullptr if the stream is invalid
+    const unsigned char *decodeBlock(size_t &blockSize)
+    {
+        uint64_t position = decoded - windowStart;
+
+        // Slide the window in whole blocks, block headers are parsed at aligned positions
+        if (position + KRAKEN_BLOCK_SIZE > windowSize) {
+            uint64_t shift = position - historySize;
+
+            if (!inPlace)
+                memmove(window, window + shift, historySize);
+
+            windowStart += shift;
+            windowSlid = true;
+            position = historySize;
+        }
+
+        unsigned char *windowBase = inPlace ? window + windowStart : window;
+
+        if (!Kraken_DecodeStep(decoder, windowBase, static_cast<int>(position), size - decoded, src + consumed, srcSize - consumed))
+            return nullptr;
+
+        if (decoder->src_used <= 0 || decoder->dst_used <= 0 || static_cast<uint64_t>(decoder->src_used) > srcSize - consumed)
+            return nullptr;
+
+        consumed += decoder->src_used;
+        decoded += decoder->dst_used;
+        blockSize = decoder->dst_used;
+        return windowBase + position;
+    }
+private:
+    const unsigned char *src;
+    uint64_t srcSize;
+    uint64_t size;
+    unsigned char *window;
+    uint64_t windowSize;
+    uint64_t historySize;
+    bool inPlace;
+    KrakenDecoder *decoder;
+    uint64_t consumed = 0;
+    uint64_t decoded = 0;
+    uint64_t windowStart = 0;
+    bool windowSlid = false;
+};
+
+// Independently decodable part of a Kraken stream, starting at a block that restarts the decoder
+struct KrakenSegment {
+    uint64_t srcOffset;
+    uint64_t dstOffset;
+};
+
+// Find the blocks that restart the decoder by walking the block and quantum headers, without decoding
+// Returns false if the headers are invalid, or the decoder uses smaller quanta that can't be skipped this way
+static bool findRestartPoints(const unsigned char *src, uint64_t srcSize, uint64_t size, std::vector<KrakenSegment> &restartPoints)
+{
+    uint64_t consumed = 0;
+
+    for (uint64_t decoded = 0; decoded < size; decoded += KRAKEN_BLOCK_SIZE) {
+        if (srcSize - consumed < 2)
+            return false;
+
+        // Block header: restart and uncompressed flags, then decoder type and checksum flag
+        const unsigned char *header = src + consumed;
+        int decoderType = header[1] & 0x7F;
+        bool checksums = (header[1] & 0x80) != 0;
+
+        if ((header[0] & 0x3F) != 0x0C || (decoderType != 6 && decoderType != 10 && decoderType != 12))
+            return false;
+
+        if ((header[0] & 0x80) != 0)
+            restartPoints.push_back({consumed, decoded});
+
+        consumed += 2;
+
+        if ((header[0] & 0x40) != 0) {
+            // Uncompressed block
+            consumed += std::min<uint64_t>(KRAKEN_BLOCK_SIZE, size - decoded);
+        }
+        else {
+            // Quantum header: 18-bit compressed size minus one, or a memset quantum
+            if (srcSize - consumed < 3)
+                return false;
+
+            const unsigned char *quantum = src + consumed;
+            uint32_t value = (quantum[0] << 16) | (quantum[1] << 8) | quantum[2];
+
+            if ((value & 0x3FFFF) != 0x3FFFF)
+                consumed += (checksums ? 6 : 3) + (value & 0x3FFFF) + 1;
+            else if ((value >> 18) == 1)
+                consumed += 4;
+            else
+                return false;
+        }
+
+        if (consumed > srcSize)
+            return false;
+    }
+
+    return true;
+}
+
+// Decode a Kraken stream into the buffer one block after another, each one allowed to reference all earlier output
+static bool decodeKrakenSerial(const unsigned char *src, uint64_t srcSize, uint64_t size, unsigned char *buffer)
+{
+    KrakenStream stream(src, srcSize, size, buffer, MAX_STREAM_WINDOW_SIZE, MAX_STREAM_WINDOW_SIZE - KRAKEN_BLOCK_SIZE, true);
+
+    while (!stream.finished()) {
+        size_t blockSize;
+
+        if (stream.decodeBlock(blockSize) == nullptr)
+            return false;
+    }
+
+    return true;
+}
+
+// Decode the segments of a Kraken stream on up to threadCount threads, each as if it started a new stream
+// Returns false if a segment fails to decode on its own, or doesn't start with the output a serial decode gives
+static bool decodeKrakenSegments(const unsigned char *src, uint64_t size, unsigned char *buffer,
+    const std::vector<KrakenSegment> &segments, unsigned int threadCount)
+{
+    std::vector<std::unique_ptr<KrakenStream>> streams;
+
+    for (size_t i = 0; i + 1 < segments.size(); i++) {
+        streams.emplace_back(new KrakenStream(src + segments[i].srcOffset, segments[i + 1].srcOffset - segments[i].srcOffset,
+            segments[i + 1].dstOffset - segments[i].dstOffset, buffer + segments[i].dstOffset,
+            MAX_STREAM_WINDOW_SIZE, MAX_STREAM_WINDOW_SIZE - KRAKEN_BLOCK_SIZE, true));
+    }
+
+    // Decoding a block may write up to SAFE_SPACE bytes past its end, so the last block of each
+    // segment but the final one is left for later, to keep it from overwriting the next segment
+    std::atomic<size_t> nextSegment(0);
+    std::atomic<bool> failed(false);
+
+    auto decodeWorker = [&]() {
+        for (size_t i = nextSegment++; i < streams.size() && !failed; i = nextSegment++) {
+            uint64_t length = segments[i + 1].dstOffset - segments[i].dstOffset;
+            uint64_t end = i + 1 == streams.size() ? length : (length - 1) & ~static_cast<uint64_t>(KRAKEN_BLOCK_SIZE - 1);
+
+            while (streams[i]->decodedSize() < end) {
+                size_t blockSize;
+
+                if (streams[i]->decodeBlock(blockSize) == nullptr) {
+                    failed = true;
+                    break;
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+
+    for (size_t i = 1; i < std::min<size_t>(threadCount, streams.size()); i++)
+        threads.emplace_back(decodeWorker);
+
+    decodeWorker();
+
+    for (auto &thread : threads)
+        thread.join();
+
+    if (failed)
+        return false;
+
+    // Decode the remaining blocks in order, restoring the start of the next segment after each
+    for (size_t i = 0; i + 1 < streams.size(); i++) {
+        std::array<unsigned char, SAFE_SPACE> nextStart;
+        memcpy(nextStart.data(), buffer + segments[i + 1].dstOffset, SAFE_SPACE);
+
+        while (!streams[i]->finished()) {
+            size_t blockSize;
+
+            if (streams[i]->decodeBlock(blockSize) == nullptr)
+                return false;
+        }
+
+        memcpy(buffer + segments[i + 1].dstOffset, nextStart.data(), SAFE_SPACE);
+    }
+
+    // A decoder at the very start of its output handles the first bytes differently, so decode the first
+    // block of each segment again where a serial decode has it, behind the output before it, and compare
+    // Later blocks decode the same either way, or fail on references before the start of their segment
+    KrakenDecoder *decoder = Kraken_Create();
+    std::vector<unsigned char> segmentStart;
+    bool matches = true;
+
+    for (size_t i = 1; i + 1 < segments.size() && matches; i++) {
+        uint64_t position = std::min<uint64_t>(segments[i].dstOffset, MAX_STREAM_WINDOW_SIZE - KRAKEN_BLOCK_SIZE);
+        unsigned char *blockStart = buffer + segments[i].dstOffset;
+        size_t length = static_cast<size_t>(std::min<uint64_t>(KRAKEN_BLOCK_SIZE, size - segments[i].dstOffset));
+        segmentStart.assign(blockStart, blockStart + length + SAFE_SPACE);
+
+        matches = Kraken_DecodeStep(decoder, blockStart - position, static_cast<int>(position), size - segments[i].dstOffset,
+            src + segments[i].srcOffset, segments[i + 1].srcOffset - segments[i].srcOffset)
+            && static_cast<size_t>(decoder->dst_used) == length && memcmp(blockStart, segmentStart.data(), length) == 0;
+
+        memcpy(blockStart, segmentStart.data(), length + SAFE_SPACE);
+    }
+
+    Kraken_Destroy(decoder);
+    return matches;
+}
+
+// Decode a Kraken stream into the buffer, with up to threadCount threads if it has restart points to split it at
+// The output is always that of a serial decode, which is used instead if the segments don't decode the same on their own
+static bool decodeKraken(const unsigned char *src, uint64_t srcSize, uint64_t size, unsigned char *buffer, unsigned int threadCount)
+{
+    // Split the stream into one segment per thread, at the restart points closest to even sizes
+    std::vector<KrakenSegment> restartPoints;
+    std::vector<KrakenSegment> segments = {{0, 0}};
+
+    if (threadCount > 1 && size > KRAKEN_BLOCK_SIZE && findRestartPoints(src, srcSize, size, restartPoints)) {
+        uint64_t segmentSize = size / threadCount;
+
+        for (const auto &restartPoint : restartPoints) {
+            if (restartPoint.dstOffset - segments.back().dstOffset >= segmentSize)
+                segments.push_back(restartPoint);
+        }
+    }
+
+    segments.push_back({srcSize, size});
+
+    if (segments.size() > 2 && decodeKrakenSegments(src, size, buffer, segments, threadCount))
+        return true;
+
+    return decodeKrakenSerial(src, srcSize, size, buffer);
+}
+
+// Get the compressed stream of an entry, skipping the oodle header if there's one
+static const unsigned char *compressedData(const MemoryMappedFile *memoryMappedFile, const ResourceEntry &entry, uint64_t &zSize)
+{
+    uint64_t offset = entry.offset;
+    zSize = entry.zSize;
+
+    // Check oodle flags
+    if ((entry.compressionMode & 4) != 0) {
+        if (zSize < 12)
+            throw ResourceError("Failed to decompress " + entry.name + ".");
+
+        offset += 12;
+        zSize -= 12;
+    }
+
+    return memoryMappedFile->memp + offset;
+}
+
+// Decompress entry into the given buffer, which must hold at least size + SAFE_SPACE bytes
+// Large streams with decoder restart points are decoded on up to threadCount threads
+size_t ResourceArchive::decompressEntry(const ResourceEntry &entry, unsigned char *buffer, size_t bufferSize, unsigned int threadCount) const
+{
+    if (bufferSize < entry.size + SAFE_SPACE)
+        throw ResourceError("Buffer is too small to decompress " + entry.name + ".");
+
+    if (!rawPaths.empty()) {
+        auto rawFile = openRawFile(entry);
+        return rawFile->decompressEntry(rawFile->entries[0], buffer, bufferSize, threadCount);
+    }
+
+    if (entry.size == 0)
+        return 0;
+
+    if (entry.size == entry.zSize) {
+        // File is decompressed, copy as-is
+        memcpy(buffer, memoryMappedFile->memp + entry.offset, entry.size);
+        return entry.size;
+    }
+
+    // File is kraken-compressed, decompress with ooz
+    uint64_t zSize;
+    const unsigned char *data = compressedData(memoryMappedFile, entry, zSize);
+
+    if (!decodeKraken(data, zSize, entry.size, buffer, threadCount))
+        throw ResourceError("Failed to decompress " + entry.name + ".");
+
+    return entry.size;
+}
+
+// Whether readEntry needs a buffer for the entry, rather than returning its mapped data
+// Raw files are unmapped once their entry is read, so their data is always copied
+bool ResourceArchive::needsBuffer(const ResourceEntry &entry) const
+{
+    return !rawPaths.empty() || (entry.size != 0 && entry.size != entry.zSize);
+}
+
+// Get entry data, decompressing it into the given buffer if needed
+const unsigned char *ResourceArchive::readEntry(const ResourceEntry &entry, std::unique_ptr<unsigned char[]> &buffer, unsigned int threadCount) const
+{
+    if (!needsBuffer(entry)) {
+        // File is empty or decompressed, use the mapped data as-is
+        return memoryMappedFile->memp + entry.offset;
+    }
+
+    buffer.reset(new(std::nothrow) unsigned char[entry.size + SAFE_SPACE]);
+
+    if (buffer == nullptr)
+        throw ResourceError("Failed to allocate memory for extraction.");
+
+    PhaseTimer timer(Phase::Decompress, entry.size);
+    decompressEntry(entry, buffer.get(), entry.size + SAFE_SPACE, threadCount);
+    return buffer.get();
+}
+
+// Get the size of the window an entry is streamed through with a buffer of about bufferSize bytes
+static uint64_t streamWindowSize(uint64_t bufferSize)
+{
+    uint64_t windowSize = std::min<uint64_t>(bufferSize, MAX_STREAM_WINDOW_SIZE) & ~static_cast<uint64_t>(KRAKEN_BLOCK_SIZE - 1);
+    return std::max<uint64_t>(windowSize, 2 * KRAKEN_BLOCK_SIZE);
+}
+
+// Decode a compressed entry through a window of about bufferSize bytes, passing each block to the writer
+// Returns false if the entry references data further back than the window keeps, with written set to the bytes passed
+// to the writer before that
+static bool decodeStream(const MemoryMappedFile *memoryMappedFile, const ResourceEntry &entry, uint64_t bufferSize, FileWriter &writer, uint64_t &written)
+{
+    // Keep half of the window when sliding it, so output is moved once on average
+    uint64_t windowSize = streamWindowSize(bufferSize);
+    uint64_t historySize = (windowSize / 2) & ~static_cast<uint64_t>(KRAKEN_BLOCK_SIZE - 1);
+
+    std::unique_ptr<unsigned char[]> window(new(std::nothrow) unsigned char[windowSize + SAFE_SPACE]);
+
+    if (window == nullptr)
+        throw ResourceError("Failed to allocate memory for extraction.");
+
+    uint64_t zSize;
+    const unsigned char *data = compressedData(memoryMappedFile, entry, zSize);
+    KrakenStream stream(data, zSize, entry.size, window.get(), windowSize, historySize, false);
+    written = 0;
+
+    while (!stream.finished()) {
+        const unsigned char *block;
+        size_t blockSize;
+
+        {
+            PhaseTimer timer(Phase::Decompress, KRAKEN_BLOCK_SIZE);
+            block = stream.decodeBlock(blockSize);
+        }
+
+        if (block == nullptr && stream.slid())
+            return false;
+
+        if (block == nullptr)
+            throw ResourceError("Failed to decompress " + entry.name + ".");
+
+        writer.write(block, blockSize);
+        written += blockSize;
+    }
+
+    return true;
+}
+
+// Decompress entry using a buffer of about bufferSize bytes, passing the data to the writer as it's decoded
+// Matches can reach further back than the half of the buffer kept. Streaming then stops and returns false, with written
+// set to the bytes already passed to the writer, which are correct. The rest must be decompressed some other way.
+bool ResourceArchive::streamEntry(const ResourceEntry &entry, FileWriter &writer, uint64_t bufferSize, uint64_t &written) const
+{
+    if (!rawPaths.empty()) {
+        auto rawFile = openRawFile(entry);
+        return rawFile->streamEntry(rawFile->entries[0], writer, bufferSize, written);
+    }
+
+    if (entry.size == 0 || entry.size == entry.zSize) {
+        // File is empty or decompressed, write the mapped data as-is
+        writer.write(memoryMappedFile->memp + entry.offset, entry.size);
+        written = entry.size;
+        return true;
+    }
+
+    return decodeStream(memoryMappedFile, entry, bufferSize, writer, written);
+}
+
+// Get at least the first length bytes of the entry, or all of it if it's smaller, by only decoding its first block
+// length can't be more than KRAKEN_BLOCK_SIZE and is set to the number of bytes available. Compressed entries are
+// decoded into the buffer, which is allocated on first use and can be reused for the next entries.
+const unsigned char *ResourceArchive::peekEntry(const ResourceEntry &entry, std::unique_ptr<unsigned char[]> &buffer, size_t &length) const
+{
+    if (length > KRAKEN_BLOCK_SIZE)
+        throw ResourceError("Can't peek at more than the first block of " + entry.name + ".");
+
+    if (!rawPaths.empty()) {
+        auto rawFile = openRawFile(entry);
+        const unsigned char *data = rawFile->peekEntry(rawFile->entries[0], buffer, length);
+
+        if (data == buffer.get())
+            return data;
+
+        // Stored data is only mapped while the raw file is open, keep a copy
+        if (buffer == nullptr)
+            buffer.reset(new(std::nothrow) unsigned char[KRAKEN_BLOCK_SIZE + SAFE_SPACE]);
+
+        if (buffer == nullptr)
+            throw ResourceError("Failed to allocate memory for extraction.");
+
+        memmove(buffer.get(), data, length);
+        return buffer.get();
+    }
+
+    if (entry.size == 0 || entry.size == entry.zSize) {
+        // File is empty or decompressed, use the mapped data as-is
+        length = static_cast<size_t>(std::min<uint64_t>(length, entry.size));
+        return memoryMappedFile->memp + entry.offset;
+    }
+
+    if (buffer == nullptr)
+        buffer.reset(new(std::nothrow) unsigned char[KRAKEN_BLOCK_SIZE + SAFE_SPACE]);
+
+    if (buffer == nullptr)
+        throw ResourceError("Failed to allocate memory for extraction.");
+
+    uint64_t zSize;
+    const unsigned char *data = compressedData(memoryMappedFile, entry, zSize);
+    KrakenStream stream(data, zSize, entry.size, buffer.get(), KRAKEN_BLOCK_SIZE, 0, true);
+
+    PhaseTimer timer(Phase::Decompress, KRAKEN_BLOCK_SIZE);
+    const unsigned char *block = stream.decodeBlock(length);
+
+    if (block == nullptr)
+        throw ResourceError("Failed to decompress " + entry.name + ".");
+
+    return block;
+}
+
+// Extract entry to the given out directory, keeping its path inside the archive
+void ResourceArchive::extractEntry(const ResourceEntry &entry, const std::string &outPath) const
+{
+    DirectorySink sink(outPath);
+    std::unique_ptr<unsigned char[]> buffer;
+    sink.writeFile(entry, readEntry(entry, buffer));
+}
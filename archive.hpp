@@ -0,0 +1,78 @@
+#ifndef ARCHIVE_HPP
+#define ARCHIVE_HPP
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+#include "mmap/mmap.hpp"
+#include "ooz.hpp"
+
+// Memory used to decompress large entries in a stream, older output is flushed and dropped
+#define STREAM_BUFFER_SIZE (256ULL << 20)
+
+// Kraken_DecodeStep takes an int offset into the window, so it can't reach 2 GB
+#define MAX_STREAM_WINDOW_SIZE ((1ULL << 31) - 2 * KRAKEN_BLOCK_SIZE)
+
+// Header of a single file copied out by --raw: "ERAW", version, size, zSize and compression mode, then the name
+#define RAW_VERSION 1
+#define RAW_HEADER_SIZE 36
+
+// Supported archive formats
+enum class ArchiveType {
+    Resources,
+    Wad7,
+    Raw
+};
+
+// File stored inside an archive
+struct ResourceEntry {
+    std::string name;
+    uint64_t offset;
+    uint64_t size;
+    uint64_t zSize;
+    uint64_t compressionMode;
+};
+
+// Error thrown when an archive can't be read or extracted
+class ResourceError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+class FileWriter;
+
+// Memory mapped .resources or .wad7 archive with its parsed index
+class ResourceArchive {
+public:
+    ArchiveType type;
+    MemoryMappedFile *memoryMappedFile;
+    std::vector<ResourceEntry> entries;
+
+    explicit ResourceArchive(const fs::path &path);
+    explicit ResourceArchive(const std::vector<fs::path> &rawPaths);
+    ~ResourceArchive();
+
+    ResourceArchive(const ResourceArchive&) = delete;
+    ResourceArchive &operator=(const ResourceArchive&) = delete;
+
+    const ResourceEntry *findEntry(const std::string &name) const;
+    bool needsBuffer(const ResourceEntry &entry) const;
+    size_t decompressEntry(const ResourceEntry &entry, unsigned char *buffer, size_t bufferSize, unsigned int threadCount = 1) const;
+    const unsigned char *readEntry(const ResourceEntry &entry, std::unique_ptr<unsigned char[]> &buffer, unsigned int threadCount = 1) const;
+    bool streamEntry(const ResourceEntry &entry, FileWriter &writer, uint64_t bufferSize, uint64_t &written) const;
+    const unsigned char *peekEntry(const ResourceEntry &entry, std::unique_ptr<unsigned char[]> &buffer, size_t &length) const;
+    void extractEntry(const ResourceEntry &entry, const std::string &outPath) const;
+private:
+    std::unordered_map<std::string, size_t> entryIndices;
+    std::vector<fs::path> rawPaths;
+
+    void parseResource();
+    void parseWad7();
+    void parseRaw();
+    void addEntry(ResourceEntry &&entry);
+    std::unique_ptr<ResourceArchive> openRawFile(const ResourceEntry &entry) const;
+};
+
+#endif
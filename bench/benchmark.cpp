@@ -0,0 +1,217 @@
+#include <iostream>
+#include <algorithm>
+#include <iomanip>
+#include <chrono>
+#include "generator.hpp"
+#include "extract.hpp"
+#include "utils.hpp"
+
+namespace chrono = std::chrono;
+
+// Seconds elapsed since the given time point
+static double secondsSince(chrono::steady_clock::time_point begin)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+}
+
+// Print a single benchmark phase result
+static void printPhase(const std::string &phase, double seconds, size_t files, uint64_t bytes)
+{
+    std::cout << "  " << std::left << std::setw(12) << phase << std::right << std::fixed
+        << std::setw(10) << std::setprecision(2) << seconds * 1000 << " ms"
+        << std::setw(14) << std::setprecision(0) << files / seconds << " files/s";
+
+    if (bytes != 0)
+        std::cout << std::setw(12) << std::setprecision(1) << bytes / seconds / (1024 * 1024) << " MB/s";
+
+    std::cout << '\n';
+}
+
+// Run every benchmark phase against the given archive
+static void benchmarkArchive(const std::string &archivePath, const fs::path &workPath, const std::vector<std::regex> &regexesToMatch, const std::vector<std::regex> &regexesNotToMatch, unsigned int threadCount, unsigned int iterations)
+{
+    // Index parsing
+    auto begin = chrono::steady_clock::now();
+
+    for (unsigned int i = 1; i < iterations; i++)
+        ResourceArchive archive(archivePath);
+
+    ResourceArchive archive(archivePath);
+    double parseSeconds = secondsSince(begin) / iterations;
+
+    uint64_t totalSize = 0;
+    uint64_t totalZSize = 0;
+
+    for (const auto &entry : archive.entries) {
+        totalSize += entry.size;
+        totalZSize += entry.zSize;
+    }
+
+    std::cout << fs::path(archivePath).filename().string() << " (" << archive.entries.size() << " files, "
+        << std::fixed << std::setprecision(1) << totalSize / (1024.0 * 1024) << " MB, "
+        << totalZSize / (1024.0 * 1024) << " MB compressed)\n";
+    printPhase("parse", parseSeconds, archive.entries.size(), 0);
+
+    // Name filtering
+    size_t matched = 0;
+    begin = chrono::steady_clock::now();
+
+    for (const auto &entry : archive.entries)
+        matched += shouldExtractFile(entry.name, regexesToMatch, regexesNotToMatch);
+
+    printPhase("filter", secondsSince(begin), archive.entries.size(), 0);
+
+    // Decompression into a reused buffer, with each ooz build linked in
+    std::vector<unsigned char> buffer;
+    const std::vector<std::string> builds = oozBuilds();
+    const std::string defaultBuild = currentOozBuild();
+    std::vector<double> buildSeconds;
+
+    for (const auto &build : builds) {
+        selectOozBuild(build);
+        begin = chrono::steady_clock::now();
+
+        for (const auto &entry : archive.entries) {
+            if (buffer.size() < entry.size + SAFE_SPACE)
+                buffer.resize(entry.size + SAFE_SPACE);
+
+            archive.decompressEntry(entry, buffer.data(), buffer.size(), threadCount);
+        }
+
+        buildSeconds.push_back(secondsSince(begin));
+        printPhase(builds.size() == 1 ? "decompress" : "ooz " + build, buildSeconds.back(), archive.entries.size(), totalSize);
+    }
+
+    selectOozBuild(defaultBuild);
+
+    // Compare the builds from source with the prebuilt library
+    auto prebuilt = std::find(builds.begin(), builds.end(), "prebuilt");
+
+    if (builds.size() > 1 && prebuilt != builds.end()) {
+        std::cout << "  speedup over prebuilt:";
+
+        for (size_t i = 0; i < builds.size(); i++) {
+            if (builds[i] != "prebuilt")
+                std::cout << ' ' << builds[i] << ' ' << std::setprecision(2) << buildSeconds[prebuilt - builds.begin()] / buildSeconds[i] << 'x';
+        }
+
+        std::cout << '\n';
+    }
+
+    // Extraction to disk
+    fs::path outPath = workPath / "out";
+    fs::remove_all(outPath);
+    fs::create_directories(outPath);
+
+    DirectorySink sink(outPath.string());
+    ExtractOptions options;
+    options.threadCount = threadCount;
+    begin = chrono::steady_clock::now();
+    extractFiles(archive, sink, options);
+    double writeSeconds = secondsSince(begin);
+
+    printPhase("extract", writeSeconds, archive.entries.size(), totalSize);
+    std::cout << "  " << matched << " of " << archive.entries.size() << " files matched the filter\n\n";
+    fs::remove_all(outPath);
+}
+
+int main(int argc, char **argv)
+{
+    std::ios::sync_with_stdio(false);
+
+    // Parse arguments
+    argh::parser cmdl;
+    cmdl.add_params({"--format", "-n", "--count", "--min-size", "--max-size", "--distribution", "--compressibility", "--stored", "--depth", "--level", "--seed",
+        "-f", "--filter", "-r", "--regex", "-t", "--threads", "-i", "--iterations", "--work-dir"});
+    cmdl.parse(argc, argv);
+
+    if (cmdl[{"-h", "--help"}]) {
+        std::cout << "Usage:\n";
+        std::cout << "EternalResourceBenchmark [.resources/.wad7 files...] [options]\n\n";
+        std::cout << "Measures index parsing, filtering, decompression and extraction throughput. If no archives\n"
+            << "are given, synthetic .resources (both header versions) and .wad7 files are generated first.\n\n";
+        std::cout << "Options:\n\n";
+        std::cout << "-h, --help\t\tDisplay this help message and exit\n\n";
+        std::cout << "-f, --filter=FILTERS\tFilter to benchmark name matching with (default: *.decl;!dir0/*).\n\n";
+        std::cout << "-r, --regex=REGEXES\tSimilar to -f, but allows full regular expressions to be passed.\n\n";
+        std::cout << "-t, --threads=N\t\tNumber of threads to extract and decompress large files with (default: 1).\n\n";
+        std::cout << "-i, --iterations=N\tNumber of times to parse each index (default: 5).\n\n";
+        std::cout << "--work-dir=DIR\t\tDirectory for generated archives and extracted files (default: temp).\n\n";
+        std::cout << "Generator options:\n\n";
+        printGeneratorOptionsHelp();
+        std::cout.flush();
+        return 1;
+    }
+
+    unsigned int threadCount;
+    unsigned int iterations;
+
+    if (!(cmdl({"-t", "--threads"}, 1) >> threadCount) || threadCount == 0)
+        throwError("Invalid thread count: " + cmdl({"-t", "--threads"}).str());
+
+    if (!(cmdl({"-i", "--iterations"}, 5) >> iterations) || iterations == 0)
+        throwError("Invalid iteration count: " + cmdl({"-i", "--iterations"}).str());
+
+    // Get regexes to match/not match
+    std::vector<std::regex> regexesToMatch;
+    std::vector<std::regex> regexesNotToMatch;
+    std::vector<std::pair<std::string, std::string>> filterParams;
+
+    for (const auto &param : cmdl.params()) {
+        if (param.first == "f" || param.first == "filter" || param.first == "r" || param.first == "regex")
+            filterParams.push_back(param);
+    }
+
+    if (filterParams.empty())
+        filterParams.emplace_back("f", "*.decl;!dir0/*");
+
+    compileRegexes(regexesToMatch, regexesNotToMatch, filterParams);
+
+    fs::path workPath = cmdl("--work-dir", (fs::temp_directory_path() / "EternalResourceBenchmark").string()).str();
+    fs::create_directories(workPath);
+
+    // Generate synthetic archives if none were given
+    std::vector<std::string> archivePaths(cmdl.pos_args().begin() + 1, cmdl.pos_args().end());
+
+    if (archivePaths.empty()) {
+        GeneratorOptions defaults;
+        defaults.entryCount = 5000;
+        defaults.maxSize = 256 * 1024;
+
+        const std::vector<std::pair<std::string, std::string>> formats = {
+            {"resources", "synthetic.resources"}, {"resources12", "synthetic12.resources"}, {"wad7", "synthetic.wad7"}
+        };
+
+        for (const auto &format : formats) {
+            GeneratorOptions options = parseGeneratorOptions(cmdl, defaults);
+            options.type = format.first == "wad7" ? ArchiveType::Wad7 : ArchiveType::Resources;
+            options.version = format.first == "resources12" ? 0xC : 0xD;
+
+            std::string archivePath = (workPath / format.second).string();
+            std::cout << "Generating " << archivePath << "...\n";
+            std::cout.flush();
+
+            try {
+                generateArchive(archivePath, options);
+            }
+            catch (const ResourceError &e) {
+                throwError(e.what());
+            }
+
+            archivePaths.push_back(archivePath);
+        }
+
+        std::cout << '\n';
+    }
+
+    for (const auto &archivePath : archivePaths) {
+        try {
+            benchmarkArchive(archivePath, workPath, regexesToMatch, regexesNotToMatch, threadCount, iterations);
+        }
+        catch (const ResourceError &e) {
+            throwError(e.what());
+        }
+    }
+
+    std::cout.flush();
+}
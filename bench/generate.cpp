@@ -0,0 +1,35 @@
+#include <iostream>
+#include "generator.hpp"
+#include "utils.hpp"
+
+int main(int argc, char **argv)
+{
+    std::ios::sync_with_stdio(false);
+
+    // Parse arguments
+    argh::parser cmdl;
+    cmdl.add_params({"--format", "-n", "--count", "--min-size", "--max-size", "--distribution", "--compressibility", "--stored", "--depth", "--level", "--seed"});
+    cmdl.parse(argc, argv);
+
+    if (cmdl[{"-h", "--help"}] || cmdl.pos_args().size() != 2) {
+        std::cout << "Usage:\n";
+        std::cout << "EternalResourceGenerator [out file] [options]\n\n";
+        std::cout << "Writes a synthetic .resources or .wad7 file for benchmarking.\n\n";
+        std::cout << "Options:\n\n";
+        printGeneratorOptionsHelp();
+        std::cout.flush();
+        return 1;
+    }
+
+    GeneratorOptions options = parseGeneratorOptions(cmdl);
+    GeneratorResult result;
+
+    try {
+        result = generateArchive(cmdl.pos_args()[1], options);
+    }
+    catch (const ResourceError &e) {
+        throwError(e.what());
+    }
+
+    std::cout << "Wrote " << result.entryCount << " files, " << result.totalSize << " bytes (" << result.totalZSize << " compressed) to " << cmdl.pos_args()[1] << "." << std::endl;
+}
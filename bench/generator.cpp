@@ -0,0 +1,310 @@
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "generator.hpp"
+#include "ooz.hpp"
+#include "utils.hpp"
+
+// Read generator options from the command line
+GeneratorOptions parseGeneratorOptions(const argh::parser &cmdl, const GeneratorOptions &defaults)
+{
+    GeneratorOptions options = defaults;
+    std::string format = cmdl("--format", options.type == ArchiveType::Wad7 ? "wad7" : options.version >= 0xD ? "resources" : "resources12").str();
+
+    if (format == "resources") {
+        options.type = ArchiveType::Resources;
+        options.version = 0xD;
+    }
+    else if (format == "resources12") {
+        options.type = ArchiveType::Resources;
+        options.version = 0xC;
+    }
+    else if (format == "wad7") {
+        options.type = ArchiveType::Wad7;
+    }
+    else {
+        throwError("Invalid format: " + format);
+    }
+
+    std::string distribution = cmdl("--distribution", options.sizeDistribution == SizeDistribution::Uniform ? "uniform" : "log").str();
+
+    if (distribution != "log" && distribution != "uniform")
+        throwError("Invalid size distribution: " + distribution);
+
+    options.sizeDistribution = distribution == "uniform" ? SizeDistribution::Uniform : SizeDistribution::LogUniform;
+
+    if (!(cmdl({"-n", "--count"}, options.entryCount) >> options.entryCount)
+    || !(cmdl("--min-size", options.minSize) >> options.minSize)
+    || !(cmdl("--max-size", options.maxSize) >> options.maxSize)
+    || !(cmdl("--compressibility", options.compressibility) >> options.compressibility)
+    || !(cmdl("--stored", options.storedFraction) >> options.storedFraction)
+    || !(cmdl("--depth", options.directoryDepth) >> options.directoryDepth)
+    || !(cmdl("--level", options.level) >> options.level)
+    || !(cmdl("--seed", options.seed) >> options.seed))
+        throwError("Invalid generator options.");
+
+    if (options.minSize > options.maxSize || (options.type == ArchiveType::Wad7 && options.maxSize > UINT32_MAX))
+        throwError("Invalid size range.");
+
+    options.oodleHeaders = options.oodleHeaders || cmdl["--oodle-headers"];
+    return options;
+}
+
+// Display help for the generator options
+void printGeneratorOptionsHelp()
+{
+    std::cout << "--format=FORMAT\t\tresources (version 13 header), resources12 or wad7 (default: resources).\n\n";
+    std::cout << "-n, --count=N\t\tNumber of files (default: 10000).\n\n";
+    std::cout << "--min-size=BYTES\tMinimum file size (default: 0).\n\n";
+    std::cout << "--max-size=BYTES\tMaximum file size (default: 1048576).\n\n";
+    std::cout << "--distribution=DIST\tFile size distribution, log or uniform (default: log).\n\n";
+    std::cout << "--compressibility=X\tFraction of each file made of repeated phrases, 0 to 1 (default: 0.7).\n\n";
+    std::cout << "--stored=X\t\tFraction of files stored without compression (default: 0.1).\n\n";
+    std::cout << "--depth=N\t\tNumber of directories in each file path (default: 3).\n\n";
+    std::cout << "--oodle-headers\t\tPrepend the 12-byte oodle header to compressed files.\n\n";
+    std::cout << "--level=N\t\tKraken compression level (default: 4).\n\n";
+    std::cout << "--seed=N\t\tRandom seed, the same options and seed give the same archive (default: 1).\n\n";
+}
+
+// Seek to absolute position in a possibly large file
+static void seekFile(FILE *file, uint64_t position)
+{
+#ifdef _WIN32
+    _fseeki64(file, static_cast<int64_t>(position), SEEK_SET);
+#else
+    fseeko(file, static_cast<off_t>(position), SEEK_SET);
+#endif
+}
+
+// Append little/big endian integers to a byte vector
+static void appendLE(std::vector<uint8_t> &bytes, uint64_t value, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        bytes.push_back(static_cast<uint8_t>(value >> (i * 8)));
+}
+
+static void appendBE(std::vector<uint8_t> &bytes, uint64_t value, size_t size)
+{
+    for (size_t i = size; i > 0; i--)
+        bytes.push_back(static_cast<uint8_t>(value >> ((i - 1) * 8)));
+}
+
+static void writeLE(std::vector<uint8_t> &bytes, size_t position, uint64_t value, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        bytes[position + i] = static_cast<uint8_t>(value >> (i * 8));
+}
+
+// Generate a path with the given number of directories
+static std::string generateName(std::mt19937_64 &rng, size_t index, unsigned int directoryDepth)
+{
+    static const char *extensions[] = {".decl", ".bimage", ".tga", ".entities", ".bmd6model", ".lwo", ".json", ".bwskeleton"};
+    std::string name;
+
+    for (unsigned int i = 0; i < directoryDepth; i++)
+        name += "dir" + std::to_string(rng() % 8) + "/";
+
+    return name + "file" + std::to_string(index) + extensions[rng() % 8];
+}
+
+// Generate file contents, a compressibility of 1 gives only repeated phrases and 0 only random bytes
+static void generateData(std::mt19937_64 &rng, std::vector<uint8_t> &data, double compressibility)
+{
+    static const char phrases[] = "declType( material2 ) { edit = { RenderLayers = { item[0] = { parms = { smoothness = { filePath = \"textures/";
+    std::uniform_real_distribution<double> chance(0, 1);
+
+    for (size_t position = 0; position < data.size(); position += 64) {
+        size_t blockSize = std::min<size_t>(64, data.size() - position);
+
+        if (chance(rng) < compressibility) {
+            size_t phraseStart = rng() % (sizeof(phrases) - 65);
+            memcpy(data.data() + position, phrases + phraseStart, blockSize);
+        }
+        else {
+            for (size_t i = 0; i < blockSize; i++)
+                data[position + i] = static_cast<uint8_t>(rng());
+        }
+    }
+}
+
+// Generate the next file, compressing it unless it's chosen to be stored
+static uint64_t generateEntry(std::mt19937_64 &rng, const GeneratorOptions &options, std::vector<uint8_t> &data, std::vector<uint8_t> &compressed, std::vector<uint8_t> &decoded, bool &isCompressed)
+{
+    std::uniform_real_distribution<double> chance(0, 1);
+    uint64_t size;
+
+    if (options.sizeDistribution == SizeDistribution::Uniform) {
+        size = std::uniform_int_distribution<uint64_t>(options.minSize, options.maxSize)(rng);
+    }
+    else {
+        double logMin = std::log(static_cast<double>(options.minSize) + 1);
+        double logMax = std::log(static_cast<double>(options.maxSize) + 1);
+        size = static_cast<uint64_t>(std::exp(std::uniform_real_distribution<double>(logMin, logMax)(rng))) - 1;
+    }
+
+    data.resize(size);
+    generateData(rng, data, options.compressibility);
+    isCompressed = false;
+
+    if (size == 0 || chance(rng) < options.storedFraction)
+        return size;
+
+    // Store the file if kraken can't make it smaller
+    size_t headerSize = options.oodleHeaders ? 12 : 0;
+    compressed.resize(headerSize + size + 65536);
+    memset(compressed.data(), 0, headerSize);
+    int zSize = Kraken_Compress(data.data(), size, compressed.data() + headerSize, options.level);
+
+    if (zSize <= 0 || zSize + headerSize >= size)
+        return size;
+
+    // Store the file if the stream doesn't decode back to it, so extraction benchmarks never hit bad data
+    decoded.resize(size + SAFE_SPACE);
+
+    if (Kraken_Decompress(compressed.data() + headerSize, zSize, decoded.data(), size) != static_cast<int>(size)
+    || memcmp(decoded.data(), data.data(), size) != 0)
+        return size;
+
+    compressed.resize(zSize + headerSize);
+    isCompressed = true;
+    return compressed.size();
+}
+
+// Write a synthetic .resources or .wad7 archive
+GeneratorResult generateArchive(const std::string &path, const GeneratorOptions &options)
+{
+    FILE *file = fopen(path.c_str(), "wb");
+
+    if (file == nullptr)
+        throw ResourceError("Failed to open " + path + " for writing: " + strerror(errno));
+
+    setvbuf(file, nullptr, _IOFBF, 1 << 20);
+
+    std::mt19937_64 rng(options.seed);
+    std::vector<std::string> names;
+    names.reserve(options.entryCount);
+
+    for (size_t i = 0; i < options.entryCount; i++)
+        names.push_back(generateName(rng, i, options.directoryDepth));
+
+    // Reserve space for the header and tables before the data in resources files
+    uint64_t headerSize = options.type == ArchiveType::Wad7 ? 35 : (options.version >= 0xD ? 36 : 32) + 72;
+    uint64_t namesSize = 8 + 8 * names.size();
+
+    for (const auto &name : names)
+        namesSize += name.length() + 1;
+
+    uint64_t idsSize = 16 * names.size() + 8;
+    uint64_t dataStart = headerSize;
+
+    if (options.type == ArchiveType::Resources)
+        dataStart += namesSize + idsSize + 144 * names.size();
+
+    seekFile(file, dataStart);
+
+    // Write file data
+    GeneratorResult result = {options.entryCount, 0, 0};
+    std::vector<ResourceEntry> entries;
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> compressed;
+    std::vector<uint8_t> decoded;
+    uint64_t offset = dataStart;
+
+    for (size_t i = 0; i < options.entryCount; i++) {
+        bool isCompressed;
+        uint64_t zSize = generateEntry(rng, options, data, compressed, decoded, isCompressed);
+        const auto &bytes = isCompressed ? compressed : data;
+
+        if (fwrite(bytes.data(), 1, zSize, file) != zSize) {
+            fclose(file);
+            throw ResourceError("Failed to write " + path + ": " + strerror(errno));
+        }
+
+        entries.push_back({names[i], offset, data.size(), zSize, isCompressed && options.oodleHeaders ? 4u : 0u});
+        offset += zSize;
+        result.totalSize += data.size();
+        result.totalZSize += zSize;
+    }
+
+    std::vector<uint8_t> header;
+
+    if (options.type == ArchiveType::Resources) {
+        // Header, name table, name id table and file info table
+        header.resize(headerSize);
+        memcpy(header.data(), "IDCL", 4);
+        writeLE(header, 4, options.version, 4);
+
+        size_t position = options.version >= 0xD ? 36 : 32;
+        writeLE(header, position, entries.size(), 4);
+        writeLE(header, position + 32, headerSize, 8);
+        writeLE(header, position + 48, headerSize + namesSize + idsSize, 8);
+        writeLE(header, position + 64, headerSize + namesSize, 8);
+
+        appendLE(header, names.size(), 8);
+        uint64_t nameOffset = 0;
+
+        for (const auto &name : names) {
+            appendLE(header, nameOffset, 8);
+            nameOffset += name.length() + 1;
+        }
+
+        for (const auto &name : names)
+            header.insert(header.end(), name.c_str(), name.c_str() + name.length() + 1);
+
+        appendLE(header, 0, 8);
+
+        for (size_t i = 0; i < entries.size(); i++) {
+            appendLE(header, i, 8);
+            appendLE(header, 0, 8);
+        }
+
+        for (size_t i = 0; i < entries.size(); i++) {
+            size_t infoStart = header.size();
+            header.resize(infoStart + 144);
+            writeLE(header, infoStart + 32, 2 * i, 8);
+            writeLE(header, infoStart + 56, entries[i].offset, 8);
+            writeLE(header, infoStart + 64, entries[i].zSize, 8);
+            writeLE(header, infoStart + 72, entries[i].size, 8);
+            writeLE(header, infoStart + 112, entries[i].compressionMode, 8);
+        }
+
+        seekFile(file, 0);
+    }
+    else {
+        // Index after the data, then its location in the header
+        std::vector<uint8_t> index;
+        appendBE(index, entries.size(), 4);
+
+        for (const auto &entry : entries) {
+            appendLE(index, entry.name.length(), 4);
+            index.insert(index.end(), entry.name.begin(), entry.name.end());
+            appendBE(index, entry.offset, 8);
+            appendBE(index, entry.size, 4);
+            appendBE(index, entry.zSize, 4);
+            appendBE(index, entry.compressionMode, 4);
+            index.resize(index.size() + 12);
+        }
+
+        if (fwrite(index.data(), 1, index.size(), file) != index.size()) {
+            fclose(file);
+            throw ResourceError("Failed to write " + path + ": " + strerror(errno));
+        }
+
+        header.resize(19);
+        writeLE(header, 0, 131121354, 4);
+        appendBE(header, offset, 8);
+        appendBE(header, index.size(), 8);
+        seekFile(file, 0);
+    }
+
+    bool success = fwrite(header.data(), 1, header.size(), file) == header.size();
+
+    if (fclose(file) != 0 || !success)
+        throw ResourceError("Failed to write " + path + ": " + strerror(errno));
+
+    return result;
+}
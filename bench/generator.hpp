@@ -0,0 +1,41 @@
+#ifndef GENERATOR_HPP
+#define GENERATOR_HPP
+
+#include <string>
+#include "archive.hpp"
+#include "argh/argh.h"
+
+// Distribution of generated file sizes between minSize and maxSize
+enum class SizeDistribution {
+    Uniform,
+    LogUniform
+};
+
+// Parameters for a synthetic archive
+struct GeneratorOptions {
+    ArchiveType type = ArchiveType::Resources;
+    uint32_t version = 0xD;
+    size_t entryCount = 10000;
+    uint64_t minSize = 0;
+    uint64_t maxSize = 1024 * 1024;
+    SizeDistribution sizeDistribution = SizeDistribution::LogUniform;
+    double compressibility = 0.7;
+    double storedFraction = 0.1;
+    unsigned int directoryDepth = 3;
+    bool oodleHeaders = false;
+    int level = 4;
+    uint64_t seed = 1;
+};
+
+// Totals of a generated archive
+struct GeneratorResult {
+    size_t entryCount;
+    uint64_t totalSize;
+    uint64_t totalZSize;
+};
+
+GeneratorOptions parseGeneratorOptions(const argh::parser &cmdl, const GeneratorOptions &defaults = GeneratorOptions());
+void printGeneratorOptionsHelp();
+GeneratorResult generateArchive(const std::string &path, const GeneratorOptions &options);
+
+#endif
@@ -0,0 +1,305 @@
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include "blob.hpp"
+#include "stats.hpp"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+// FNV-1a hash of a file name, never zero so zero can mark empty slots
+uint64_t hashBlobName(const char *name, size_t length)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    for (size_t i = 0; i < length; i++) {
+        hash ^= static_cast<unsigned char>(name[i]);
+        hash *= 0x100000001B3ULL;
+    }
+
+    return hash == 0 ? 1 : hash;
+}
+
+// BlobSink constructor
+BlobSink::BlobSink(const std::string &blobPath) : blobPath(blobPath), blobSize(0)
+{
+#ifdef _WIN32
+    blobFile = _wfopen(fs::path(blobPath).c_str(), L"wb");
+
+    if (blobFile == nullptr)
+#else
+    blobFileDescriptor = open(blobPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (blobFileDescriptor == -1)
+#endif
+        throw ResourceError("Failed to open " + blobPath + " for writing: " + strerror(errno));
+}
+
+// BlobSink destructor
+BlobSink::~BlobSink()
+{
+#ifdef _WIN32
+    fclose(blobFile);
+#else
+    close(blobFileDescriptor);
+#endif
+}
+
+// Reserve an aligned range at the end of the blob, so writers don't wait on each other
+uint64_t BlobSink::reserve(uint64_t size)
+{
+    uint64_t alignedSize = (size + BLOB_ALIGNMENT - 1) & ~static_cast<uint64_t>(BLOB_ALIGNMENT - 1);
+    return blobSize.fetch_add(alignedSize);
+}
+
+// Write data of the given file at an offset in the blob
+void BlobSink::writeAt(const std::string &name, uint64_t offset, const unsigned char *data, uint64_t size)
+{
+    PhaseTimer timer(Phase::Write, size);
+
+#ifdef _WIN32
+    std::lock_guard<std::mutex> lock(recordsMutex);
+
+    if (_fseeki64(blobFile, offset, SEEK_SET) != 0 || fwrite(data, 1, size, blobFile) != size)
+        throw ResourceError("Failed to write " + name + " to " + blobPath + ": " + strerror(errno));
+#else
+    for (uint64_t written = 0; written < size;) {
+        ssize_t result = pwrite(blobFileDescriptor, data + written, size - written, offset + written);
+
+        if (result == -1) {
+            if (errno == EINTR)
+                continue;
+
+            throw ResourceError("Failed to write " + name + " to " + blobPath + ": " + strerror(errno));
+        }
+
+        written += result;
+    }
+#endif
+}
+
+// Record the location of a file written to the blob
+void BlobSink::addRecord(const ResourceEntry &entry, uint64_t offset)
+{
+    std::lock_guard<std::mutex> lock(recordsMutex);
+    records.push_back({&entry, entry.name, offset, entry.size});
+}
+
+// Append file to the blob
+void BlobSink::writeFile(const ResourceEntry &entry, const unsigned char *data)
+{
+    uint64_t offset = reserve(entry.size);
+    writeAt(entry.name, offset, data, entry.size);
+    addRecord(entry, offset);
+}
+
+// Writes a file into its reserved range of the blob piece by piece
+class BlobSink::BlobFileWriter : public FileWriter {
+public:
+    BlobFileWriter(BlobSink &sink, const ResourceEntry &entry) : sink(sink), entry(entry), offset(sink.reserve(entry.size)) {}
+
+    void write(const unsigned char *data, size_t size) override
+    {
+        sink.writeAt(entry.name, offset + written, data, size);
+        written += size;
+    }
+
+    void close() override
+    {
+        sink.addRecord(entry, offset);
+    }
+private:
+    BlobSink &sink;
+    const ResourceEntry &entry;
+    uint64_t offset;
+    uint64_t written = 0;
+};
+
+// Open file in the blob to be written in pieces
+std::unique_ptr<FileWriter> BlobSink::openFile(const ResourceEntry &entry)
+{
+    return std::unique_ptr<FileWriter>(new BlobFileWriter(*this, entry));
+}
+
+// Pad the blob to its final size and write the index next to it
+void BlobSink::finish()
+{
+#ifdef _WIN32
+    if (_fseeki64(blobFile, 0, SEEK_END) != 0 || (blobSize > 0 && _chsize_s(_fileno(blobFile), blobSize) != 0))
+#else
+    if (ftruncate(blobFileDescriptor, blobSize) == -1)
+#endif
+        throw ResourceError("Failed to write " + blobPath + ": " + strerror(errno));
+
+    writeIndex();
+}
+
+// Build the hash index and write it to <blob path>.idx
+void BlobSink::writeIndex()
+{
+    // Keep the last file with each name in index order, whatever order the threads wrote them in.
+    // The entries all live in the archive's entry list, so their addresses follow index order.
+    std::sort(records.begin(), records.end(), [](const BlobRecord &a, const BlobRecord &b) {
+        return std::less<const ResourceEntry*>()(a.entry, b.entry);
+    });
+
+    // Use a power of two slot count with at most 50% load
+    uint64_t slotCount = 16;
+
+    while (slotCount < records.size() * 2)
+        slotCount *= 2;
+
+    std::vector<BlobIndexSlot> slots(slotCount);
+    std::string names;
+    uint64_t entryCount = 0;
+
+    for (const auto &record : records) {
+        uint64_t hash = hashBlobName(record.name.data(), record.name.length());
+        uint64_t slot = hash & (slotCount - 1);
+        bool duplicate = false;
+
+        while (slots[slot].hash != 0) {
+            if (slots[slot].hash == hash && slots[slot].nameLength == record.name.length()
+            && memcmp(names.data() + slots[slot].nameOffset, record.name.data(), record.name.length()) == 0) {
+                duplicate = true;
+                break;
+            }
+
+            slot = (slot + 1) & (slotCount - 1);
+        }
+
+        if (duplicate) {
+            slots[slot].offset = record.offset;
+            slots[slot].size = record.size;
+            continue;
+        }
+
+        slots[slot] = {hash, record.offset, record.size, static_cast<uint32_t>(names.length()), static_cast<uint32_t>(record.name.length())};
+        names += record.name;
+        entryCount++;
+    }
+
+    BlobIndexHeader header = {{'E', 'R', 'B', 'I'}, 1, slotCount, entryCount, sizeof(BlobIndexHeader) + slotCount * sizeof(BlobIndexSlot)};
+
+    // Write index file
+    std::string indexPath = blobPath + ".idx";
+#ifdef _WIN32
+    FILE *indexFile = _wfopen(fs::path(indexPath).c_str(), L"wb");
+#else
+    FILE *indexFile = fopen(indexPath.c_str(), "wb");
+#endif
+
+    if (indexFile == nullptr)
+        throw ResourceError("Failed to open " + indexPath + " for writing: " + strerror(errno));
+
+    bool success = fwrite(&header, sizeof(header), 1, indexFile) == 1
+        && fwrite(slots.data(), sizeof(BlobIndexSlot), slots.size(), indexFile) == slots.size()
+        && fwrite(names.data(), 1, names.length(), indexFile) == names.length();
+
+    if (fclose(indexFile) != 0 || !success)
+        throw ResourceError("Failed to write " + indexPath + ": " + strerror(errno));
+}
+
+// Check that every slot of the index stays inside the index and the blob, and that lookups end at an empty slot
+static bool isValidBlobIndex(const MemoryMappedFile &indexFile, uint64_t blobSize)
+{
+    if (indexFile.size < sizeof(BlobIndexHeader))
+        return false;
+
+    const auto *header = reinterpret_cast<const BlobIndexHeader*>(indexFile.memp);
+
+    if (memcmp(header->magic, "ERBI", 4) != 0 || header->version != 1
+    || header->slotCount == 0 || (header->slotCount & (header->slotCount - 1)) != 0
+    || header->slotCount > (indexFile.size - sizeof(BlobIndexHeader)) / sizeof(BlobIndexSlot)
+    || header->namesOffset < sizeof(BlobIndexHeader) + header->slotCount * sizeof(BlobIndexSlot)
+    || header->namesOffset > indexFile.size)
+        return false;
+
+    const auto *slots = reinterpret_cast<const BlobIndexSlot*>(indexFile.memp + sizeof(BlobIndexHeader));
+    uint64_t namesSize = indexFile.size - header->namesOffset;
+    uint64_t usedSlots = 0;
+
+    for (uint64_t i = 0; i < header->slotCount; i++) {
+        if (slots[i].hash == 0)
+            continue;
+
+        if (static_cast<uint64_t>(slots[i].nameOffset) + slots[i].nameLength > namesSize
+        || slots[i].offset > blobSize || slots[i].size > blobSize - slots[i].offset)
+            return false;
+
+        usedSlots++;
+    }
+
+    return usedSlots < header->slotCount && usedSlots == header->entryCount;
+}
+
+// BlobIndex constructor
+BlobIndex::BlobIndex(const std::string &blobPath)
+{
+    std::error_code ec;
+    uint64_t blobSize = fs::file_size(blobPath, ec);
+
+    if (ec.value() != 0)
+        throw ResourceError("Failed to open " + blobPath + " for reading.");
+
+    try {
+        indexFile = new MemoryMappedFile(blobPath + ".idx");
+    }
+    catch (const std::exception &e) {
+        throw ResourceError("Failed to open " + blobPath + ".idx for reading.");
+    }
+
+    if (!isValidBlobIndex(*indexFile, blobSize)) {
+        delete indexFile;
+        throw ResourceError(blobPath + ".idx is not a valid blob index.");
+    }
+
+    header = reinterpret_cast<const BlobIndexHeader*>(indexFile->memp);
+    slots = reinterpret_cast<const BlobIndexSlot*>(indexFile->memp + sizeof(BlobIndexHeader));
+
+    // Empty blobs can't be mapped
+    if (blobSize == 0)
+        return;
+
+    try {
+        blobFile = new MemoryMappedFile(blobPath);
+    }
+    catch (const std::exception &e) {
+        delete indexFile;
+        throw ResourceError("Failed to open " + blobPath + " for reading.");
+    }
+}
+
+// BlobIndex destructor
+BlobIndex::~BlobIndex()
+{
+    delete blobFile;
+    delete indexFile;
+}
+
+// Find file by name, returns nullptr if it doesn't exist
+const unsigned char *BlobIndex::find(const std::string &name, uint64_t &size) const
+{
+    const char *names = reinterpret_cast<const char*>(indexFile->memp + header->namesOffset);
+    uint64_t hash = hashBlobName(name.data(), name.length());
+
+    for (uint64_t slot = hash & (header->slotCount - 1); slots[slot].hash != 0; slot = (slot + 1) & (header->slotCount - 1)) {
+        if (slots[slot].hash == hash && slots[slot].nameLength == name.length()
+        && memcmp(names + slots[slot].nameOffset, name.data(), name.length()) == 0) {
+            size = slots[slot].size;
+            return blobFile != nullptr ? blobFile->memp + slots[slot].offset : indexFile->memp;
+        }
+    }
+
+    return nullptr;
+}
+
+// Get number of files in the index
+uint64_t BlobIndex::entryCount() const
+{
+    return header->entryCount;
+}
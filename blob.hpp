@@ -0,0 +1,86 @@
+#ifndef BLOB_HPP
+#define BLOB_HPP
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "sink.hpp"
+
+#define BLOB_ALIGNMENT 64
+
+// Header at the start of a blob index file
+struct BlobIndexHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t slotCount;
+    uint64_t entryCount;
+    uint64_t namesOffset;
+};
+
+// Open addressing hash table slot, a zero hash marks an empty slot
+struct BlobIndexSlot {
+    uint64_t hash;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+};
+
+uint64_t hashBlobName(const char *name, size_t length);
+
+// Writes every file into a single aligned blob, plus a hash index mapping names to data
+class BlobSink : public OutputSink {
+public:
+    explicit BlobSink(const std::string &blobPath);
+    ~BlobSink() override;
+
+    void writeFile(const ResourceEntry &entry, const unsigned char *data) override;
+    std::unique_ptr<FileWriter> openFile(const ResourceEntry &entry) override;
+    void finish() override;
+private:
+    class BlobFileWriter;
+
+    // Location of a file inside the blob
+    struct BlobRecord {
+        const ResourceEntry *entry;
+        std::string name;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    std::string blobPath;
+    std::atomic<uint64_t> blobSize;
+    std::mutex recordsMutex;
+    std::vector<BlobRecord> records;
+#ifdef _WIN32
+    FILE *blobFile;
+#else
+    int blobFileDescriptor;
+#endif
+
+    uint64_t reserve(uint64_t size);
+    void writeAt(const std::string &name, uint64_t offset, const unsigned char *data, uint64_t size);
+    void addRecord(const ResourceEntry &entry, uint64_t offset);
+    void writeIndex();
+};
+
+// Memory mapped blob and its index, for looking up decompressed files by name
+class BlobIndex {
+public:
+    BlobIndex(const std::string &blobPath);
+    ~BlobIndex();
+
+    BlobIndex(const BlobIndex&) = delete;
+    BlobIndex &operator=(const BlobIndex&) = delete;
+
+    const unsigned char *find(const std::string &name, uint64_t &size) const;
+    uint64_t entryCount() const;
+private:
+    MemoryMappedFile *indexFile;
+    MemoryMappedFile *blobFile = nullptr;
+    const BlobIndexHeader *header;
+    const BlobIndexSlot *slots;
+};
+
+#endif
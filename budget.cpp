@@ -0,0 +1,57 @@
+#include "budget.hpp"
+
+// MemoryBudget constructor
+MemoryBudget::MemoryBudget(uint64_t limit) : limit(limit)
+{
+}
+
+// Wait until it's the ticket's turn and the bytes fit in the budget, returns false if aborted
+bool MemoryBudget::acquire(uint64_t ticket, uint64_t bytes)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    released.wait(lock, [&]() { return aborted || (ticket == nextTicket && (used + bytes <= limit || used == 0)); });
+
+    if (aborted)
+        return false;
+
+    used += bytes;
+    nextTicket++;
+    released.notify_all();
+    return true;
+}
+
+// Add bytes to a reservation of heldBytes that was already admitted, waiting until they fit in the budget or no other
+// reservation is left, returns false if aborted
+bool MemoryBudget::expand(uint64_t heldBytes, uint64_t bytes)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    released.wait(lock, [&]() { return aborted || used + bytes <= limit || used == heldBytes; });
+
+    if (aborted)
+        return false;
+
+    used += bytes;
+    return true;
+}
+
+// Give back reserved bytes, waking waiting reservations
+void MemoryBudget::release(uint64_t bytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        used -= bytes;
+    }
+
+    released.notify_all();
+}
+
+// Wake and fail all waiting reservations
+void MemoryBudget::abort()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        aborted = true;
+    }
+
+    released.notify_all();
+}
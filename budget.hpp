@@ -0,0 +1,30 @@
+#ifndef BUDGET_HPP
+#define BUDGET_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// Byte-counting admission controller for decompression buffers
+//
+// Reservations are admitted strictly in ticket order, so the oldest file always makes progress.
+// A reservation larger than the whole budget is admitted once nothing else is reserved, and then
+// holds back everything else until it is released, so it effectively runs alone.
+class MemoryBudget {
+public:
+    explicit MemoryBudget(uint64_t limit);
+
+    bool acquire(uint64_t ticket, uint64_t bytes);
+    bool expand(uint64_t heldBytes, uint64_t bytes);
+    void release(uint64_t bytes);
+    void abort();
+private:
+    uint64_t limit;
+    uint64_t used = 0;
+    uint64_t nextTicket = 0;
+    bool aborted = false;
+    std::mutex mutex;
+    std::condition_variable released;
+};
+
+#endif
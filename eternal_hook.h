@@ -0,0 +1,59 @@
+#ifndef ETERNAL_HOOK_H
+#define ETERNAL_HOOK_H
+
+/*
+ * C interface for EternalResourceExtractor hook plugins, loaded with --hook=PLUGIN[;ARGS].
+ *
+ * A plugin is a shared library that exports eternal_hook_process, and optionally eternal_hook_init and
+ * eternal_hook_finish. eternal_hook_process receives every decompressed file before it's written, on the
+ * extraction worker threads, so it must be thread safe. The data points straight into the extraction buffers
+ * and is only valid during the call.
+ *
+ * Files are usually passed whole in a single call. Files too large to be held in memory are passed in pieces,
+ * in order, and *file_state can be used to keep state between the pieces of a file: it starts out NULL, and
+ * should be released by the plugin on the last piece, where offset + size == file->size.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ETERNAL_HOOK_VERSION 1
+
+/* eternal_hook_process results, the write decision of a file is taken from its first piece */
+#define ETERNAL_HOOK_WRITE 0
+#define ETERNAL_HOOK_SKIP 1
+#define ETERNAL_HOOK_ERROR (-1)
+
+/* File being extracted */
+typedef struct EternalHookFile {
+    const char *name;
+    uint64_t offset;
+    uint64_t size;
+    uint64_t z_size;
+    uint64_t compression_mode;
+} EternalHookFile;
+
+#ifdef _WIN32
+#define ETERNAL_HOOK_EXPORT __declspec(dllexport)
+#else
+#define ETERNAL_HOOK_EXPORT __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Called once before extraction with ETERNAL_HOOK_VERSION and the ARGS given after the plugin path (or ""), returns 0 on success */
+typedef int (*EternalHookInit)(int version, const char *args, void **context);
+
+/* Called for each piece of each file, returns ETERNAL_HOOK_WRITE, ETERNAL_HOOK_SKIP or ETERNAL_HOOK_ERROR */
+typedef int (*EternalHookProcess)(void *context, const EternalHookFile *file, const unsigned char *data, uint64_t offset, size_t size, void **file_state);
+
+/* Called once after the last file, returns 0 on success */
+typedef int (*EternalHookFinish)(void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
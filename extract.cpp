@@ -1,105 +1,16 @@
-#include <filesystem>
-#include <iostream>
 #include <regex>
-#include <cstring>
-#include "utils.hpp"
-#include "ooz.hpp"
-#include "mmap/mmap.hpp"
-
-// Extract file from memory
-void extractFile(const MemoryMappedFile *memoryMappedFile, const std::string &name, const std::string &outPath, size_t offset, size_t size, size_t zSize, size_t compressionMode)
-{
-    std::cout << "Extracting " << name << "...\n";
-
-    // Create out directory
-    auto filePath = fs::path(outPath + name).make_preferred();
-    mkpath(filePath, outPath.length());
-
-    if (mkpath(filePath, outPath.length()) != 0)
-        throwError("Failed to create " + filePath.parent_path().string() + " path for extraction: " + strerror(errno));
-
-    if (fs::is_directory(filePath)) {
-        filePath += " (1)";
-    }
-
-    if (size == 0) {
-        // Create empty file and continue
-#ifdef _WIN32
-        FILE *exportFile = _wfopen(filePath.c_str(), L"wb");
-#else
-        FILE *exportFile = fopen(filePath.c_str(), "wb");
-#endif
-        fclose(exportFile);
-    }
-    else if (size == zSize) {
-        // File is decompressed, extract as-is
-#ifdef _WIN32
-        MemoryMappedFile *outFile;
-
-        try {
-            outFile = new MemoryMappedFile(filePath, size, true, true);
-        }
-        catch (const std::exception &e) {
-            throwError("Failed to extract " + filePath.string() + " for reading.");
-        }
-
-        memcpy(outFile->memp, memoryMappedFile->memp + offset, size);
-        delete outFile;
-#else
-        FILE *exportFile = fopen(filePath.c_str(), "wb");
-
-        if (exportFile == nullptr)
-            throwError("Failed to open " + filePath.string() + " for writing: " + strerror(errno));
-
-        fwrite(memoryMappedFile->memp + offset, 1, size, exportFile);
-        fclose(exportFile);
-#endif
-    }
-    else {
-        // File is kraken-compressed, decompress with ooz
-
-        // Check oodle flags
-        if ((compressionMode & 4) != 0) {
-            offset += 12;
-            zSize -= 12;
-        }
-
-        // Decompress file
-        auto *decBytes = new(std::nothrow) unsigned char[size + SAFE_SPACE];
-
-        if (decBytes == nullptr)
-            throwError("Failed to allocate memory for extraction.");
-
-        if (Kraken_Decompress(memoryMappedFile->memp + offset, static_cast<int32_t>(zSize),
-        decBytes, size) != size)
-            throwError("Failed to decompress " + name + ".");
-
-        // Write file to disk
-#ifdef _WIN32
-        MemoryMappedFile *outFile;
-
-        try {
-            outFile = new MemoryMappedFile(filePath, size, true, true);
-        }
-        catch (const std::exception &e) {
-            throwError("Failed to open " + filePath.string() + " for writing.");
-        }
-
-        memcpy(outFile->memp, decBytes, size);
-        delete outFile;
-#else
-        FILE *exportFile = fopen(filePath.c_str(), "wb");
-
-        if (exportFile == nullptr)
-            throwError("Failed to open " + filePath.string() + " for writing: " + strerror(errno));
-
-        fwrite(decBytes, 1, size, exportFile);
-        fclose(exportFile);
-#endif
-
-        delete[] decBytes;
-    }
-}
+#include <algorithm>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <thread>
+#include "extract.hpp"
+#include "stats.hpp"
+#include "budget.hpp"
+#include "sniff.hpp"
+#include "raw.hpp"
 
 // Check whether we should extract the file based on the include/exclude regexes
 bool shouldExtractFile(const std::string &name, const std::vector<std::regex> &regexesToMatch, const std::vector<std::regex> &regexesNotToMatch)
@@ -127,149 +38,437 @@ bool shouldExtractFile(const std::string &name, const std::vector<std::regex> &r
     return extract;
 }
 
-// Extract all files from resources file
-size_t extractResource(MemoryMappedFile *memoryMappedFile, const std::string &outPath, const std::vector<std::regex> &regexesToMatch, const std::vector<std::regex> &regexesNotToMatch)
+// Match index metadata with the predicate and filenames with regexes, then the types detected from the files' first
+// bytes if any were given. Only the first step is needed to leave out most files, and it doesn't touch their data.
+// If entryTypes is given, it's set to the type of each file returned, reusing the types sniffed for filtering.
+static std::vector<const ResourceEntry*> filterEntries(const ResourceArchive &archive, const ExtractOptions &options, std::vector<std::string> *entryTypes)
 {
-    // Read resource data
-    size_t memPosition = 4;
+    std::vector<const ResourceEntry*> entries;
 
-    uint32_t version = memoryMappedFile->readUint32LE(memPosition);
+    for (const auto &entry : archive.entries) {
+        PhaseTimer timer(Phase::Filter, entry.size);
 
-    if (version >= 0xD) {
-        memPosition = 36;
+        if (options.where.matches(entry) && shouldExtractFile(entry.name, options.regexesToMatch, options.regexesNotToMatch))
+            entries.push_back(&entry);
     }
-    else {
-        memPosition = 32;
+
+    if (options.types.empty() && entryTypes == nullptr)
+        return entries;
+
+    std::vector<std::string> types = sniffTypes(archive, entries, options.threadCount);
+
+    if (options.types.empty()) {
+        *entryTypes = std::move(types);
+        return entries;
     }
 
-    uint32_t fileCount = memoryMappedFile->readUint32LE(memPosition);
-    memPosition += 4;
+    std::vector<const ResourceEntry*> typeEntries;
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (!matchesType(types[i], options.types))
+            continue;
 
-    uint32_t dummyCount = memoryMappedFile->readUint32LE(memPosition);
-    memPosition += 20;
+        typeEntries.push_back(entries[i]);
 
-    // Get offsets
-    uint64_t namesOffset = memoryMappedFile->readUint64LE(memPosition);
-    memPosition += 8;
+        if (entryTypes != nullptr)
+            entryTypes->push_back(std::move(types[i]));
+    }
 
-    uint64_t infoOffset = memoryMappedFile->readUint64LE(memPosition);
-    memPosition += 8;
+    return typeEntries;
+}
 
-    uint64_t dummyOffset = memoryMappedFile->readUint64LE(memPosition) + dummyCount * sizeof(dummyCount);
+// Assign each file to one of shardCount shards of about equal weight, the bytes read and written plus SHARD_FILE_COST
+// Greedy: the heaviest files go first, each onto the lightest shard so far. Ties are broken by archive order and
+// shard number, so every machine given the same archive and filters computes the same assignment.
+std::vector<unsigned int> assignShards(const std::vector<const ResourceEntry*> &entries, unsigned int shardCount)
+{
+    auto weight = [](const ResourceEntry *entry) {
+        return entry->size + entry->zSize + SHARD_FILE_COST;
+    };
 
-    memPosition = namesOffset;
+    std::vector<size_t> order(entries.size());
 
-    // Get filenames for exporting
-    uint64_t nameCount = memoryMappedFile->readUint64LE(memPosition);
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
 
-    std::vector<std::string> names;
-    names.reserve(nameCount);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return weight(entries[a]) > weight(entries[b]);
+    });
 
-    size_t currentPosition = memPosition;
+    // Lightest shard on top, the lowest numbered one among equals
+    std::vector<std::pair<uint64_t, unsigned int>> loads;
 
-    for (int i = 0; i < nameCount; i++) {
-        memPosition = currentPosition + static_cast<size_t>(i) * 8;
-        uint64_t currentNameOffset = memoryMappedFile->readUint64LE(memPosition);
+    for (unsigned int shard = 0; shard < shardCount; shard++)
+        loads.emplace_back(0, shard);
 
-        memPosition = namesOffset + nameCount * 8 + currentNameOffset + 8;
-        std::string name(reinterpret_cast<char*>(memoryMappedFile->memp) + memPosition);
+    auto heavier = std::greater<std::pair<uint64_t, unsigned int>>();
+    std::vector<unsigned int> shards(entries.size());
 
-        memPosition += name.length();
-        names.push_back(name);
+    for (size_t i : order) {
+        std::pop_heap(loads.begin(), loads.end(), heavier);
+        shards[i] = loads.back().second;
+        loads.back().first += weight(entries[i]);
+        std::push_heap(loads.begin(), loads.end(), heavier);
     }
 
-    memPosition = infoOffset;
+    return shards;
+}
 
-    // Extract files
-    size_t filesExtracted = 0;
+// Get the files to extract: the ones matching the regexes, and of those the ones in this machine's shard
+// If entryTypes is given, it's set to the type detected for each file returned.
+std::vector<const ResourceEntry*> selectEntries(const ResourceArchive &archive, const ExtractOptions &options, std::vector<std::string> *entryTypes)
+{
+    std::vector<std::string> types;
+    std::vector<const ResourceEntry*> entries = filterEntries(archive, options, entryTypes != nullptr ? &types : nullptr);
 
-    for (int i = 0; i < fileCount; i++) {
-        memPosition += 32;
+    if (options.shardCount <= 1) {
+        if (entryTypes != nullptr)
+            *entryTypes = std::move(types);
 
-        // Read file info for extracting
-        uint64_t nameIdOffset = memoryMappedFile->readUint64LE(memPosition);
-        memPosition += 16;
+        return entries;
+    }
 
-        uint64_t offset = memoryMappedFile->readUint64LE(memPosition);
-        uint64_t zSize = memoryMappedFile->readUint64LE(memPosition);
-        uint64_t size = memoryMappedFile->readUint64LE(memPosition);
+    std::vector<unsigned int> shards = assignShards(entries, options.shardCount);
+    std::vector<const ResourceEntry*> shardEntries;
 
-        memPosition += 32;
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (shards[i] != options.shardIndex)
+            continue;
 
-        uint64_t zipFlags = memoryMappedFile->readUint64LE(memPosition);
-        memPosition += 24;
+        shardEntries.push_back(entries[i]);
 
-        nameIdOffset = (nameIdOffset + 1) * 8 + dummyOffset;
-        currentPosition = memPosition;
-        memPosition = nameIdOffset;
+        if (entryTypes != nullptr)
+            entryTypes->push_back(std::move(types[i]));
+    }
 
-        uint64_t nameId = memoryMappedFile->readUint64LE(memPosition);
-        std::string name = names[nameId];
+    return shardEntries;
+}
 
-        // Match filename with regexes
-        if (!shouldExtractFile(name, regexesToMatch, regexesNotToMatch)) {
-            memPosition = currentPosition;
-            continue;
+// Get the files and bytes every shard would extract
+std::vector<ShardTotals> planShards(const ResourceArchive &archive, const ExtractOptions &options)
+{
+    std::vector<const ResourceEntry*> entries = filterEntries(archive, options, nullptr);
+    std::vector<unsigned int> shards = assignShards(entries, std::max(options.shardCount, 1u));
+    std::vector<ShardTotals> totals(std::max(options.shardCount, 1u));
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        totals[shards[i]].files++;
+        totals[shards[i]].size += entries[i]->size;
+        totals[shards[i]].zSize += entries[i]->zSize;
+    }
+
+    return totals;
+}
+
+// Get the buffer size streamed files are decompressed through, the whole memory budget if there's one
+uint64_t streamBufferSize(const ExtractOptions &options)
+{
+    uint64_t streamBuffer = options.streamBuffer;
+
+    if (options.maxMemory != 0)
+        streamBuffer = options.maxMemory > SAFE_SPACE ? options.maxMemory - SAFE_SPACE : 0;
+
+    return std::max<uint64_t>(streamBuffer & ~static_cast<uint64_t>(KRAKEN_BLOCK_SIZE - 1), 2 * KRAKEN_BLOCK_SIZE);
+}
+
+// Whether a file can't be decompressed into a single buffer, because it's larger than the memory budget or than a
+// buffer Kraken_DecodeStep can address
+bool shouldStreamEntry(const ResourceEntry &entry, const ExtractOptions &options)
+{
+    if (options.raw || entry.size == 0 || entry.size == entry.zSize)
+        return false;
+
+    return entry.size > MAX_STREAM_WINDOW_SIZE || (options.maxMemory != 0 && entry.size + SAFE_SPACE > options.maxMemory);
+}
+
+// Decompress a file into the sink through the stream buffer, so it's decoded in a single pass. If it turns out to
+// reference data further back than the buffer keeps, the rest of it is taken from the whole file decompressed at once.
+// That memory is added to the reservedBytes the file holds in the budget if there's one, streamed files hold all of it
+// so this only goes over it while nothing else is in flight.
+void writeStreamedEntry(const ResourceArchive &archive, const ResourceEntry &entry, OutputSink &sink, uint64_t streamBuffer, unsigned int threadCount, MemoryBudget *memoryBudget, uint64_t reservedBytes)
+{
+    auto writer = sink.openFile(entry);
+    uint64_t written;
+
+    if (!archive.streamEntry(entry, *writer, streamBuffer, written)) {
+        uint64_t bufferBytes = entry.size + SAFE_SPACE;
+
+        if (memoryBudget != nullptr && !memoryBudget->expand(reservedBytes, bufferBytes))
+            throw ResourceError("Failed to decompress " + entry.name + ", extraction was stopped.");
+
+        try {
+            std::unique_ptr<unsigned char[]> buffer;
+            const unsigned char *data = archive.readEntry(entry, buffer, threadCount);
+            writer->write(data + written, entry.size - written);
         }
+        catch (...) {
+            if (memoryBudget != nullptr)
+                memoryBudget->release(bufferBytes);
 
-        // Extract file
-        extractFile(memoryMappedFile, name, outPath, offset, size, zSize, zipFlags);
-        filesExtracted++;
+            throw;
+        }
 
-        // Seek back to info section
-        memPosition = currentPosition;
+        if (memoryBudget != nullptr)
+            memoryBudget->release(bufferBytes);
     }
-    
-    return filesExtracted;
+
+    writer->close();
 }
 
-// Extract all files from WAD7 file
-size_t extractWad7(MemoryMappedFile *memoryMappedFile, const std::string &outPath, const std::vector<std::regex> &regexesToMatch, const std::vector<std::regex> &regexesNotToMatch)
+// Move the files matching the priority regexes to the front, in the order of the regexes, keeping the order of files
+// within each batch. Returns the batch of each file, files that match no regex are in the last one.
+static std::vector<size_t> prioritizeEntries(std::vector<const ResourceEntry*> &entries, const std::vector<std::regex> &priorities)
 {
-    size_t memPosition = 19;
+    std::vector<std::pair<size_t, const ResourceEntry*>> batchEntries;
 
-    // Get index position and size
-    uint64_t indexStart = memoryMappedFile->readUint64BE(memPosition);
-    uint64_t indexSize = memoryMappedFile->readUint64BE(memPosition);
+    for (const auto *entry : entries) {
+        size_t batch = 0;
 
-    memPosition = indexStart;
+        while (batch < priorities.size() && !std::regex_match(entry->name, priorities[batch]))
+            batch++;
 
-    // Get entry count
-    uint32_t entryCount = memoryMappedFile->readUint32BE(memPosition);
+        batchEntries.emplace_back(batch, entry);
+    }
 
-    // Extract files
-    size_t filesExtracted = 0;
+    std::stable_sort(batchEntries.begin(), batchEntries.end(), [](const auto &a, const auto &b) {
+        return a.first < b.first;
+    });
 
-    for (int i = 0; i < entryCount; i++) {
-        // Get entry name
-        uint32_t nameSize = memoryMappedFile->readUint32LE(memPosition);
+    std::vector<size_t> batches;
 
-        std::string name(reinterpret_cast<char*>(memoryMappedFile->memp) + memPosition, nameSize);
-        memPosition += nameSize;
-        
-        // Match filename with regexes
-        if (!shouldExtractFile(name, regexesToMatch, regexesNotToMatch)) {
-            memPosition += 32;
-            continue;
+    for (size_t i = 0; i < entries.size(); i++) {
+        entries[i] = batchEntries[i].second;
+        batches.push_back(batchEntries[i].first);
+    }
+
+    return batches;
+}
+
+// Extract all files matching the regexes from the archive into the sink
+// In raw mode, their stored bytes are copied out as they are instead
+size_t extractFiles(const ResourceArchive &archive, OutputSink &sink, const ExtractOptions &options)
+{
+    return extractEntries(archive, selectEntries(archive, options), sink, options);
+}
+
+// Extract the given files from the archive into the sink, ignoring the options' filters
+// Returns the number of files written, leaving out the ones that failed
+size_t extractEntries(const ResourceArchive &archive, std::vector<const ResourceEntry*> entriesToExtract, OutputSink &sink, const ExtractOptions &options)
+{
+    // Leave out the files a previous run already extracted
+    if (options.journal != nullptr) {
+        entriesToExtract.erase(std::remove_if(entriesToExtract.begin(), entriesToExtract.end(), [&](const ResourceEntry *entry) {
+            return options.journal->completed(entry - archive.entries.data());
+        }), entriesToExtract.end());
+    }
+
+    // Read data sequentially for streamed output, priority batches still go first but keep this order within each
+    if (sink.sequential()) {
+        std::stable_sort(entriesToExtract.begin(), entriesToExtract.end(), [](const ResourceEntry *a, const ResourceEntry *b) {
+            return a->offset < b->offset;
+        });
+    }
+
+    std::vector<size_t> batches = prioritizeEntries(entriesToExtract, options.priorities);
+
+    if (options.notifier != nullptr) {
+        std::vector<size_t> batchSizes(options.priorities.size() + 1);
+
+        for (size_t batch : batches)
+            batchSizes[batch]++;
+
+        options.notifier->start(batchSizes);
+    }
+
+    if (options.progress != nullptr) {
+        uint64_t totalBytes = 0;
+
+        for (const auto *entry : entriesToExtract)
+            totalBytes += entry->size;
+
+        options.progress->start(entriesToExtract.size(), totalBytes);
+    }
+
+    // Workers claim entries in order, sequential sinks receive them in that same order
+    std::atomic<size_t> nextEntry(0);
+    std::atomic<bool> failed(false);
+    std::atomic<size_t> filesWritten(0);
+    std::exception_ptr error;
+    std::mutex writeMutex;
+    std::condition_variable writeTurn;
+    size_t nextToWrite = 0;
+
+    // Limit memory used by in-flight decompression buffers
+    std::unique_ptr<MemoryBudget> memoryBudget;
+
+    if (options.maxMemory != 0)
+        memoryBudget.reset(new MemoryBudget(options.maxMemory));
+
+    // Files that can't be decompressed whole are decompressed through the stream buffer and written as they're decoded
+    uint64_t streamBuffer = streamBufferSize(options);
+
+    // Threads of workers that ran out of files help decompress the remaining large ones
+    std::atomic<unsigned int> activeWorkers(options.threadCount);
+
+    auto extractWorker = [&](unsigned int worker) {
+        std::unique_ptr<unsigned char[]> buffer;
+
+        while (!failed) {
+            // Parked workers' threads help decompress large files until they're needed again
+            if (options.tuner != nullptr && options.tuner->parked(worker)) {
+                activeWorkers--;
+                bool resumed = options.tuner->waitTurn(worker);
+                activeWorkers++;
+
+                if (!resumed)
+                    break;
+            }
+
+            size_t i = nextEntry++;
+
+            if (i >= entriesToExtract.size())
+                break;
+
+            const auto *entry = entriesToExtract[i];
+            bool buffered = !options.raw && archive.needsBuffer(*entry);
+            bool streamed = shouldStreamEntry(*entry, options);
+
+            // Streamed files take the whole budget and run alone, as they may have to be decompressed whole after all,
+            // adding the buffer for that to their reservation
+            uint64_t reservedBytes = streamed ? std::max(options.maxMemory, streamBuffer + SAFE_SPACE) : buffered ? entry->size + SAFE_SPACE : 0;
+
+            if (memoryBudget != nullptr && !memoryBudget->acquire(i, reservedBytes))
+                break;
+
+            bool extracted = true;
+            auto readBegin = std::chrono::steady_clock::now();
+            std::chrono::steady_clock::time_point writeBegin;
+
+            try {
+                // Large files are decompressed straight into the sink, so they must wait for their turn first
+                const unsigned char *data = streamed || options.raw ? nullptr : archive.readEntry(*entry, buffer, options.threadCount - activeWorkers + 1);
+                writeBegin = std::chrono::steady_clock::now();
+
+                auto writeEntry = [&]() {
+                    if (options.raw) {
+                        writeRawEntry(archive, *entry, sink);
+                    }
+                    else if (streamed) {
+                        writeStreamedEntry(archive, *entry, sink, streamBuffer, options.threadCount - activeWorkers + 1, memoryBudget.get(), reservedBytes);
+                    }
+                    else {
+                        sink.writeFile(*entry, data);
+                    }
+                };
+
+                if (sink.sequential()) {
+                    std::unique_lock<std::mutex> lock(writeMutex);
+                    writeTurn.wait(lock, [&]() { return nextToWrite == i || failed; });
+
+                    if (failed)
+                        break;
+
+                    writeEntry();
+                    nextToWrite++;
+                    writeTurn.notify_all();
+                }
+                else {
+                    writeEntry();
+                }
+
+                if (options.journal != nullptr)
+                    options.journal->fileDone(entry - archive.entries.data());
+            }
+            catch (...) {
+                // The sink may record the failure and carry on, sequential ones still get to skip the file's turn
+                bool carryOn = false;
+
+                try {
+                    throw;
+                }
+                catch (const ResourceError &e) {
+                    carryOn = sink.fileFailed(*entry, e.what());
+                }
+                catch (...) {
+                }
+
+                std::unique_lock<std::mutex> lock(writeMutex);
+
+                if (carryOn && sink.sequential()) {
+                    writeTurn.wait(lock, [&]() { return nextToWrite == i || failed; });
+                    nextToWrite++;
+                    writeTurn.notify_all();
+                }
+
+                if (!carryOn || failed) {
+                    if (!error)
+                        error = std::current_exception();
+
+                    failed = true;
+                    writeTurn.notify_all();
+
+                    if (memoryBudget != nullptr)
+                        memoryBudget->abort();
+
+                    break;
+                }
+
+                extracted = false;
+            }
+
+            if (extracted) {
+                recordFileStats(entry->zSize, entry->size);
+                filesWritten++;
+            }
+
+            if (extracted && options.tuner != nullptr) {
+                auto writeEnd = std::chrono::steady_clock::now();
+                options.tuner->fileDone(entry->size, std::chrono::duration<double>(writeBegin - readBegin).count(),
+                    std::chrono::duration<double>(writeEnd - writeBegin).count());
+            }
+
+            if (options.notifier != nullptr)
+                options.notifier->fileDone(options.raw ? entry->name + RAW_EXTENSION : entry->name, batches[i], extracted);
+
+            if (options.progress != nullptr)
+                options.progress->fileExtracted(*entry);
+
+            buffer.reset();
+
+            if (memoryBudget != nullptr)
+                memoryBudget->release(reservedBytes);
         }
 
-        // Get data offset
-        uint64_t offset = memoryMappedFile->readUint64BE(memPosition);
+        activeWorkers--;
 
-        // Get uncompressed size
-        uint32_t size = memoryMappedFile->readUint32BE(memPosition);
+        // Nothing is left to claim, parked workers can finish too
+        if (options.tuner != nullptr)
+            options.tuner->stop();
+    };
+
+    if (options.threadCount <= 1) {
+        extractWorker(0);
+    }
+    else {
+        std::vector<std::thread> threads;
 
-        // Get compressed size
-        uint32_t zSize = memoryMappedFile->readUint32BE(memPosition);
-        
-        // Get compression mode
-        uint32_t compressionMode = memoryMappedFile->readUint32BE(memPosition);
+        for (unsigned int i = 0; i < options.threadCount; i++)
+            threads.emplace_back(extractWorker, i);
 
-        // Extract file
-        extractFile(memoryMappedFile, name, outPath, offset, size, zSize, compressionMode);
-        filesExtracted++;
-        memPosition += 12;
+        for (auto &thread : threads)
+            thread.join();
     }
-    
-    return filesExtracted;
+
+    if (options.progress != nullptr)
+        options.progress->finish();
+
+    if (error)
+        std::rethrow_exception(error);
+
+    sink.finish();
+
+    if (options.notifier != nullptr)
+        options.notifier->finish(filesWritten);
+
+    return filesWritten;
 }
@@ -1,11 +1,54 @@
-#ifndef WAD7_HPP
-#define WAD7_HPP
+#ifndef EXTRACT_HPP
+#define EXTRACT_HPP
 
 #include <vector>
 #include <regex>
-#include "mmap/mmap.hpp"
+#include "archive.hpp"
+#include "sink.hpp"
+#include "progress.hpp"
+#include "predicate.hpp"
+#include "notify.hpp"
+#include "journal.hpp"
+#include "tune.hpp"
+#include "budget.hpp"
 
-size_t extractResource(MemoryMappedFile *memoryMappedFile, const std::string &outPath, const std::vector<std::regex> &regexesToMatch, const std::vector<std::regex> &regexesNotToMatch);
-size_t extractWad7(MemoryMappedFile *memoryMappedFile, const std::string &outPath, const std::vector<std::regex> &regexesToMatch, const std::vector<std::regex> &regexesNotToMatch);
+// Weight of a file in shard balancing on top of its bytes, so many small files still get spread out
+#define SHARD_FILE_COST 4096
+
+// Settings for extractFiles
+struct ExtractOptions {
+    std::vector<std::regex> regexesToMatch;
+    std::vector<std::regex> regexesNotToMatch;
+    std::vector<std::string> types;
+    EntryPredicate where;
+    std::vector<std::regex> priorities;
+    unsigned int threadCount = 1;
+    uint64_t maxMemory = 0;
+    uint64_t streamBuffer = STREAM_BUFFER_SIZE;
+    unsigned int shardIndex = 0;
+    unsigned int shardCount = 1;
+    bool raw = false;
+    ProgressReporter *progress = nullptr;
+    CompletionNotifier *notifier = nullptr;
+    ExtractJournal *journal = nullptr;
+    WorkerTuner *tuner = nullptr;
+};
+
+// Files and bytes assigned to a shard
+struct ShardTotals {
+    size_t files = 0;
+    uint64_t size = 0;
+    uint64_t zSize = 0;
+};
+
+bool shouldExtractFile(const std::string &name, const std::vector<std::regex> &regexesToMatch, const std::vector<std::regex> &regexesNotToMatch);
+std::vector<unsigned int> assignShards(const std::vector<const ResourceEntry*> &entries, unsigned int shardCount);
+std::vector<const ResourceEntry*> selectEntries(const ResourceArchive &archive, const ExtractOptions &options, std::vector<std::string> *entryTypes = nullptr);
+std::vector<ShardTotals> planShards(const ResourceArchive &archive, const ExtractOptions &options);
+uint64_t streamBufferSize(const ExtractOptions &options);
+bool shouldStreamEntry(const ResourceEntry &entry, const ExtractOptions &options);
+void writeStreamedEntry(const ResourceArchive &archive, const ResourceEntry &entry, OutputSink &sink, uint64_t streamBuffer, unsigned int threadCount, MemoryBudget *memoryBudget = nullptr, uint64_t reservedBytes = 0);
+size_t extractFiles(const ResourceArchive &archive, OutputSink &sink, const ExtractOptions &options);
+size_t extractEntries(const ResourceArchive &archive, std::vector<const ResourceEntry*> entriesToExtract, OutputSink &sink, const ExtractOptions &options);
 
 #endif
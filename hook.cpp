@@ -0,0 +1,208 @@
+#include "hook.hpp"
+#include "verify.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+// Load a symbol from the plugin, or return null if it doesn't export it
+static void *loadSymbol(void *library, const char *name)
+{
+#ifdef _WIN32
+    return reinterpret_cast<void*>(GetProcAddress(static_cast<HMODULE>(library), name));
+#else
+    return dlsym(library, name);
+#endif
+}
+
+// Unload the plugin
+static void unloadLibrary(void *library)
+{
+#ifdef _WIN32
+    FreeLibrary(static_cast<HMODULE>(library));
+#else
+    dlclose(library);
+#endif
+}
+
+// PluginHook constructor, loads the plugin and initializes it with args
+PluginHook::PluginHook(const std::string &pluginPath, const std::string &args) : pluginPath(pluginPath)
+{
+#ifdef _WIN32
+    library = LoadLibraryW(fs::path(pluginPath).c_str());
+
+    if (library == nullptr)
+        throw ResourceError("Failed to load hook " + pluginPath + ": error " + std::to_string(GetLastError()));
+#else
+    library = dlopen(pluginPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+
+    if (library == nullptr)
+        throw ResourceError("Failed to load hook " + pluginPath + ": " + dlerror());
+#endif
+
+    processFunction = reinterpret_cast<EternalHookProcess>(loadSymbol(library, "eternal_hook_process"));
+    finishFunction = reinterpret_cast<EternalHookFinish>(loadSymbol(library, "eternal_hook_finish"));
+    auto initFunction = reinterpret_cast<EternalHookInit>(loadSymbol(library, "eternal_hook_init"));
+
+    if (processFunction == nullptr) {
+        unloadLibrary(library);
+        throw ResourceError("Hook " + pluginPath + " doesn't export eternal_hook_process.");
+    }
+
+    if (initFunction != nullptr && initFunction(ETERNAL_HOOK_VERSION, args.c_str(), &context) != 0) {
+        unloadLibrary(library);
+        throw ResourceError("Hook " + pluginPath + " failed to initialize.");
+    }
+}
+
+// PluginHook destructor, unloads the plugin
+PluginHook::~PluginHook()
+{
+    unloadLibrary(library);
+}
+
+// Pass a piece of a file to the plugin
+bool PluginHook::processFile(const ResourceEntry &entry, const unsigned char *data, uint64_t offset, size_t size, void *&state)
+{
+    EternalHookFile file = {entry.name.c_str(), entry.offset, entry.size, entry.zSize, entry.compressionMode};
+    int result = processFunction(context, &file, data, offset, size, &state);
+
+    if (result == ETERNAL_HOOK_ERROR)
+        throw ResourceError("Hook " + pluginPath + " failed to process " + entry.name + ".");
+
+    return result != ETERNAL_HOOK_SKIP;
+}
+
+// Let the plugin flush its output
+void PluginHook::finish()
+{
+    if (finishFunction != nullptr && finishFunction(context) != 0)
+        throw ResourceError("Hook " + pluginPath + " failed to finish.");
+}
+
+// ChecksumHook constructor
+ChecksumHook::ChecksumHook(const std::string &manifestPath) : manifestPath(manifestPath)
+{
+}
+
+// Add a piece of a file to its checksum, recording it after the last one
+bool ChecksumHook::processFile(const ResourceEntry &entry, const unsigned char *data, uint64_t offset, size_t size, void *&state)
+{
+    // Whole files don't need a checksum state kept between calls
+    if (offset == 0 && size == entry.size) {
+        Checksum checksum;
+        checksum.update(data, size);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        checksums[entry.name] = checksum.digest();
+        return true;
+    }
+
+    if (state == nullptr)
+        state = new Checksum();
+
+    auto checksum = static_cast<Checksum*>(state);
+    checksum->update(data, size);
+
+    if (offset + size == entry.size) {
+        std::lock_guard<std::mutex> lock(mutex);
+        checksums[entry.name] = checksum->digest();
+        delete checksum;
+        state = nullptr;
+    }
+
+    return true;
+}
+
+// Write the checksums of every file as a manifest
+void ChecksumHook::finish()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    writeChecksumManifest(manifestPath, checksums);
+}
+
+// Passes each piece of a file to the hooks, then to the inner sink's writer unless the first piece was skipped
+class HookSink::HookFileWriter : public FileWriter {
+public:
+    HookFileWriter(HookSink &sink, const ResourceEntry &entry) : sink(sink), entry(entry), states(sink.hooks.size(), nullptr) {}
+
+    void write(const unsigned char *data, size_t size) override
+    {
+        bool keep = sink.runHooks(entry, data, writtenSize, size, states);
+
+        // Open the file only once the hooks decided to keep it
+        if (writtenSize == 0 && keep && sink.sink != nullptr)
+            writer = sink.sink->openFile(entry);
+
+        writtenSize += size;
+
+        if (writer)
+            writer->write(data, size);
+    }
+
+    void close() override
+    {
+        // Empty files are never written in pieces, but still go through the hooks
+        if (writtenSize == 0 && entry.size == 0)
+            write(nullptr, 0);
+
+        if (writer)
+            writer->close();
+    }
+private:
+    HookSink &sink;
+    const ResourceEntry &entry;
+    std::vector<void*> states;
+    std::unique_ptr<FileWriter> writer;
+    uint64_t writtenSize = 0;
+};
+
+// HookSink constructor
+HookSink::HookSink(std::vector<std::unique_ptr<FileHook>> &&hooks, OutputSink *sink) : hooks(std::move(hooks)), sink(sink)
+{
+}
+
+// Run every hook on a piece of a file, returns false if any of them skipped it
+bool HookSink::runHooks(const ResourceEntry &entry, const unsigned char *data, uint64_t offset, size_t size, std::vector<void*> &states)
+{
+    bool write = true;
+
+    for (size_t i = 0; i < hooks.size(); i++)
+        write = hooks[i]->processFile(entry, data, offset, size, states[i]) && write;
+
+    return write;
+}
+
+// Pass a whole file to the hooks, then write it unless one of them skipped it
+void HookSink::writeFile(const ResourceEntry &entry, const unsigned char *data)
+{
+    std::vector<void*> states(hooks.size(), nullptr);
+
+    if (runHooks(entry, data, 0, entry.size, states) && sink != nullptr)
+        sink->writeFile(entry, data);
+}
+
+// Pass a file to the hooks piece by piece
+std::unique_ptr<FileWriter> HookSink::openFile(const ResourceEntry &entry)
+{
+    return std::unique_ptr<FileWriter>(new HookFileWriter(*this, entry));
+}
+
+// Let the inner sink decide whether to carry on after a failed file
+bool HookSink::fileFailed(const ResourceEntry &entry, const std::string &error)
+{
+    return sink != nullptr && sink->fileFailed(entry, error);
+}
+
+// Finish the hooks, then the inner sink
+void HookSink::finish()
+{
+    for (auto &hook : hooks)
+        hook->finish();
+
+    if (sink != nullptr)
+        sink->finish();
+}
@@ -0,0 +1,78 @@
+#ifndef HOOK_HPP
+#define HOOK_HPP
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "sink.hpp"
+#include "eternal_hook.h"
+
+// Handler run on every decompressed file before it's written, on the extraction worker threads
+class FileHook {
+public:
+    virtual ~FileHook() = default;
+
+    // Process the next piece of a file, without copying it. Files held in memory come as a single piece, larger ones
+    // in order starting at offset 0. state is kept between the pieces of a file, starts out null and should be
+    // released on the last one. Returning false from the first piece skips writing the file.
+    virtual bool processFile(const ResourceEntry &entry, const unsigned char *data, uint64_t offset, size_t size, void *&state) = 0;
+
+    // Called after the last file
+    virtual void finish() {}
+};
+
+// Hook implemented by a shared library through the C interface in eternal_hook.h
+class PluginHook : public FileHook {
+public:
+    PluginHook(const std::string &pluginPath, const std::string &args);
+    ~PluginHook() override;
+
+    PluginHook(const PluginHook&) = delete;
+    PluginHook &operator=(const PluginHook&) = delete;
+
+    bool processFile(const ResourceEntry &entry, const unsigned char *data, uint64_t offset, size_t size, void *&state) override;
+    void finish() override;
+private:
+    std::string pluginPath;
+    void *library;
+    void *context = nullptr;
+    EternalHookProcess processFunction;
+    EternalHookFinish finishFunction;
+};
+
+// Built-in hook keeping the XXH64 checksum of every file, written to a manifest --verify can check against
+class ChecksumHook : public FileHook {
+public:
+    explicit ChecksumHook(const std::string &manifestPath);
+
+    bool processFile(const ResourceEntry &entry, const unsigned char *data, uint64_t offset, size_t size, void *&state) override;
+    void finish() override;
+private:
+    std::string manifestPath;
+    std::unordered_map<std::string, uint64_t> checksums;
+    std::mutex mutex;
+};
+
+// Passes every file through the hooks, then writes the ones none of them skipped to another sink
+// Without a sink, files are only passed to the hooks
+class HookSink : public OutputSink {
+public:
+    HookSink(std::vector<std::unique_ptr<FileHook>> &&hooks, OutputSink *sink);
+
+    void writeFile(const ResourceEntry &entry, const unsigned char *data) override;
+    std::unique_ptr<FileWriter> openFile(const ResourceEntry &entry) override;
+    bool fileFailed(const ResourceEntry &entry, const std::string &error) override;
+    void finish() override;
+    bool sequential() const override { return sink != nullptr && sink->sequential(); }
+private:
+    class HookFileWriter;
+
+    std::vector<std::unique_ptr<FileHook>> hooks;
+    OutputSink *sink;
+
+    bool runHooks(const ResourceEntry &entry, const unsigned char *data, uint64_t offset, size_t size, std::vector<void*> &states);
+};
+
+#endif
@@ -0,0 +1,139 @@
+#include <cerrno>
+#include <cstring>
+#include "journal.hpp"
+#include "verify.hpp"
+
+// Get a checksum of everything in the archive's index that decides where its files' data is
+static uint64_t archiveFingerprint(const ResourceArchive &archive)
+{
+    Checksum checksum;
+    auto add = [&](uint64_t value) {
+        unsigned char bytes[8];
+
+        for (int i = 0; i < 8; i++)
+            bytes[i] = static_cast<unsigned char>(value >> (i * 8));
+
+        checksum.update(bytes, sizeof(bytes));
+    };
+
+    add(archive.entries.size());
+
+    for (const auto &entry : archive.entries) {
+        add(entry.name.length());
+        checksum.update(reinterpret_cast<const unsigned char*>(entry.name.data()), entry.name.length());
+        add(entry.offset);
+        add(entry.size);
+        add(entry.zSize);
+        add(entry.compressionMode);
+    }
+
+    return checksum.digest();
+}
+
+// Open a journal file, reading it from the start or appending to it
+static FILE *openJournal(const std::string &journalPath, bool append)
+{
+#ifdef _WIN32
+    return _wfopen(fs::path(journalPath).c_str(), append ? L"ab" : L"rb");
+#else
+    return fopen(journalPath.c_str(), append ? "ab" : "rb");
+#endif
+}
+
+// ExtractJournal constructor, loads the completed entries if the journal was written for the same archive,
+// otherwise starts a new one
+ExtractJournal::ExtractJournal(const std::string &journalPath, const ResourceArchive &archive)
+    : journalPath(journalPath), completedEntries(archive.entries.size(), false)
+{
+    unsigned char header[JOURNAL_HEADER_SIZE];
+    memcpy(header, JOURNAL_MAGIC, 4);
+    uint64_t fingerprint = archiveFingerprint(archive);
+    uint32_t entryCount = static_cast<uint32_t>(archive.entries.size());
+
+    for (int i = 0; i < 8; i++)
+        header[4 + i] = static_cast<unsigned char>(fingerprint >> (i * 8));
+
+    for (int i = 0; i < 4; i++)
+        header[12 + i] = static_cast<unsigned char>(entryCount >> (i * 8));
+
+    bool matches = false;
+    uint64_t validSize = 0;
+    FILE *existingFile = openJournal(journalPath, false);
+
+    if (existingFile != nullptr) {
+        unsigned char existingHeader[JOURNAL_HEADER_SIZE];
+        matches = fread(existingHeader, 1, sizeof(existingHeader), existingFile) == sizeof(existingHeader)
+            && memcmp(existingHeader, header, sizeof(header)) == 0;
+        validSize = JOURNAL_HEADER_SIZE;
+
+        unsigned char record[4];
+
+        while (matches && fread(record, 1, sizeof(record), existingFile) == sizeof(record)) {
+            uint32_t index = record[0] | (record[1] << 8) | (record[2] << 16) | (static_cast<uint32_t>(record[3]) << 24);
+            validSize += sizeof(record);
+
+            if (index < completedEntries.size() && !completedEntries[index]) {
+                completedEntries[index] = true;
+                completedFiles++;
+            }
+        }
+
+        fclose(existingFile);
+    }
+
+    std::error_code ec;
+
+    // A record cut short would shift the ones appended after it, so drop it
+    if (matches)
+        fs::resize_file(fs::path(journalPath), validSize, ec);
+    else
+        fs::remove(fs::path(journalPath), ec);
+
+    if (ec.value() != 0)
+        throw ResourceError("Failed to write " + journalPath + ": " + ec.message());
+
+    journalFile = openJournal(journalPath, true);
+
+    if (journalFile == nullptr)
+        throw ResourceError("Failed to open " + journalPath + " for writing: " + strerror(errno));
+
+    if (!matches && (fwrite(header, 1, sizeof(header), journalFile) != sizeof(header) || fflush(journalFile) != 0)) {
+        fclose(journalFile);
+        throw ResourceError("Failed to write " + journalPath + ": " + strerror(errno));
+    }
+}
+
+// ExtractJournal destructor
+ExtractJournal::~ExtractJournal()
+{
+    if (journalFile != nullptr)
+        fclose(journalFile);
+}
+
+// Record an entry as extracted, called once its file was published
+void ExtractJournal::fileDone(size_t index)
+{
+    unsigned char record[4];
+
+    for (int i = 0; i < 4; i++)
+        record[i] = static_cast<unsigned char>(index >> (i * 8));
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (fwrite(record, 1, sizeof(record), journalFile) != sizeof(record) || fflush(journalFile) != 0)
+        throw ResourceError("Failed to write " + journalPath + ": " + strerror(errno));
+}
+
+// Delete the journal once every entry was extracted
+void ExtractJournal::remove()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (journalFile != nullptr) {
+        fclose(journalFile);
+        journalFile = nullptr;
+    }
+
+    std::error_code ec;
+    fs::remove(fs::path(journalPath), ec);
+}
@@ -0,0 +1,44 @@
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "archive.hpp"
+
+// Magic at the start of a journal
+#define JOURNAL_MAGIC "ERJ1"
+
+// Size of a journal's header: magic, archive fingerprint and entry count
+#define JOURNAL_HEADER_SIZE 16
+
+// Append-only record of the entries already extracted from an archive, so an interrupted extraction can be resumed
+// without checking the files already in the out directory
+//
+// Records are the 4-byte little endian indexes of the entries in the archive. A journal is only used if the
+// archive's index is the same as when it was written, and a record cut short by a crash is ignored. Each record is
+// handed to the OS as soon as its file is published, which must happen atomically, otherwise a record could point to
+// a file that was never completely written. Neither are synced to disk, so this survives the process being killed,
+// not a power loss.
+class ExtractJournal {
+public:
+    ExtractJournal(const std::string &journalPath, const ResourceArchive &archive);
+    ~ExtractJournal();
+
+    ExtractJournal(const ExtractJournal&) = delete;
+    ExtractJournal &operator=(const ExtractJournal&) = delete;
+
+    bool completed(size_t index) const { return index < completedEntries.size() && completedEntries[index]; }
+    size_t completedCount() const { return completedFiles; }
+    void fileDone(size_t index);
+    void remove();
+private:
+    std::string journalPath;
+    FILE *journalFile;
+    std::vector<bool> completedEntries;
+    size_t completedFiles = 0;
+    std::mutex mutex;
+};
+
+#endif
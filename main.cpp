@@ -1,13 +1,258 @@
 #include <iostream>
 #include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <map>
+#include <algorithm>
 #include <chrono>
 #include <array>
+#include <thread>
+#include <csignal>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 #include "extract.hpp"
+#include "blob.hpp"
+#include "pack.hpp"
+#include "verify.hpp"
+#include "hook.hpp"
+#include "raw.hpp"
+#include "watch.hpp"
+#include "server.hpp"
+#include "stats.hpp"
 #include "utils.hpp"
 #include "argh/argh.h"
 
 namespace chrono = std::chrono;
 
+// Serve files from the given archives over a Unix domain socket until interrupted
+static int serveArchives(const std::vector<std::string> &archivePaths, const std::string &socketPath, unsigned int threadCount, size_t cacheBudget)
+{
+    if (archivePaths.empty())
+        throwError("Resource file was not specified.");
+
+    // Load archive indexes
+    std::vector<std::unique_ptr<ResourceArchive>> archives;
+    ResourceFilesystem filesystem(cacheBudget);
+
+    try {
+        for (const auto &archivePath : archivePaths) {
+            archives.emplace_back(new ResourceArchive(fs::absolute(formatPath(archivePath))));
+            filesystem.addArchive(*archives.back());
+        }
+    }
+    catch (const ResourceError &e) {
+        throwError(e.what());
+    }
+
+#ifdef _WIN32
+    throwError("Serving over a Unix domain socket is not supported on Windows.");
+    return 1;
+#else
+    // Handle SIGINT/SIGTERM on a dedicated thread so the socket gets cleaned up
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    ResourceServer *server;
+
+    try {
+        server = new ResourceServer(filesystem, socketPath);
+    }
+    catch (const ResourceError &e) {
+        throwError(e.what());
+    }
+
+    std::thread([server, signals]() {
+        int signal;
+        sigwait(&signals, &signal);
+        server->stop();
+    }).detach();
+
+    std::cout << "Serving " << archives.size() << " archives on " << socketPath << "..." << std::endl;
+    server->run(threadCount);
+    delete server;
+
+    std::cout << "Server stopped." << std::endl;
+    return 0;
+#endif
+}
+
+// Keep an extracted mirror of the archives under a directory up to date until interrupted
+static int watchArchives(const std::string &gamePath, const std::string &outPath, const ExtractOptions &options, unsigned int debounceMilliseconds, bool checksums)
+{
+#ifdef _WIN32
+    throwError("Watching archives for changes is not supported on Windows.");
+    return 1;
+#else
+    std::error_code ec;
+    fs::create_directories(outPath, ec);
+
+    if (ec.value() != 0)
+        throwError("Failed to create out directory: " + ec.message());
+
+    // Handle SIGINT/SIGTERM on a dedicated thread so the current update gets to finish
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    ArchiveWatcher *watcher;
+
+    try {
+        watcher = new ArchiveWatcher(gamePath, outPath, options, debounceMilliseconds, checksums, std::cout);
+    }
+    catch (const ResourceError &e) {
+        throwError(e.what());
+    }
+
+    std::thread([watcher, signals]() {
+        int signal;
+        sigwait(&signals, &signal);
+        watcher->stop();
+    }).detach();
+
+    std::cout << "Watching " << gamePath << " for changes..." << std::endl;
+    watcher->run();
+    delete watcher;
+
+    std::cout << "Stopped watching." << std::endl;
+    return 0;
+#endif
+}
+
+// Pack the files under a directory into a .resources file
+static int packArchive(const std::vector<std::string> &args, const std::string &archivePath, PackOptions &options, bool quiet, bool progressBar)
+{
+    if (args.size() < 2)
+        throwError("Directory to pack was not specified.");
+
+    std::error_code ec;
+    const std::string directoryPath = fs::absolute(formatPath(args[1]), ec).string();
+
+    if (ec.value() != 0 || !fs::is_directory(directoryPath))
+        throwError("Failed to find directory to pack: " + args[1]);
+
+    // Report progress from a separate thread unless silenced
+    std::unique_ptr<ProgressReporter> progress;
+
+    if (!quiet) {
+#ifdef _WIN32
+        bool terminal = _isatty(_fileno(stdout));
+#else
+        bool terminal = isatty(STDOUT_FILENO);
+#endif
+        progress.reset(new ProgressReporter(progressBar ? ProgressMode::Bar : ProgressMode::Log, std::cout, terminal, "Packing"));
+        options.progress = progress.get();
+    }
+
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    PackResult result;
+
+    try {
+        result = packDirectory(directoryPath, formatPath(archivePath), options);
+    }
+    catch (const ResourceError &e) {
+        throwError(e.what());
+    }
+
+    progress.reset();
+    double totalTimeSeconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+    std::cout.clear();
+    std::cout << "\nDone, " << result.entryCount << " files packed (" << result.totalSize << " bytes, " << result.totalZSize << " compressed) in " << totalTimeSeconds << " seconds." << std::endl;
+    pressAnyKey();
+    return 0;
+}
+
+// Print the files and bytes in each shard, marking this machine's
+static void printShardPlan(const std::vector<ShardTotals> &shards, unsigned int shardIndex)
+{
+    std::cout.clear();
+    auto precision = std::cout.precision();
+    std::cout << "Shard        Files      Size (MB)  Compressed (MB)\n" << std::fixed << std::setprecision(1);
+
+    for (size_t i = 0; i < shards.size(); i++) {
+        std::string shard = std::to_string(i + 1) + "/" + std::to_string(shards.size()) + (i == shardIndex ? " *" : "");
+        std::cout << std::left << std::setw(8) << shard << std::right << std::setw(10) << shards[i].files
+            << std::setw(15) << shards[i].size / (1024.0 * 1024) << std::setw(17) << shards[i].zSize / (1024.0 * 1024) << '\n';
+    }
+
+    std::cout << std::defaultfloat << std::setprecision(precision);
+    std::cout.flush();
+}
+
+// Print the number of files and bytes of each type detected, most common first
+static void printTypes(const ResourceArchive &archive, const ExtractOptions &options)
+{
+    std::vector<std::string> types;
+    const std::vector<const ResourceEntry*> entries = selectEntries(archive, options, &types);
+    std::map<std::string, std::pair<size_t, uint64_t>> totals;
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        totals[types[i]].first++;
+        totals[types[i]].second += entries[i]->size;
+    }
+
+    std::vector<std::pair<std::string, std::pair<size_t, uint64_t>>> sortedTotals(totals.begin(), totals.end());
+
+    std::stable_sort(sortedTotals.begin(), sortedTotals.end(), [](const auto &a, const auto &b) {
+        return a.second.first > b.second.first;
+    });
+
+    std::cout.clear();
+    auto precision = std::cout.precision();
+    std::cout << "Type                Files      Size (MB)\n" << std::fixed << std::setprecision(1);
+
+    for (const auto &total : sortedTotals) {
+        std::cout << std::left << std::setw(16) << total.first << std::right << std::setw(9) << total.second.first
+            << std::setw(15) << total.second.second / (1024.0 * 1024) << '\n';
+    }
+
+    std::cout << std::defaultfloat << std::setprecision(precision);
+    std::cout.flush();
+}
+
+// Report the files that failed verification and the decompression speed, returns the exit code
+static int reportVerification(const ResourceArchive &archive, VerifySink &sink, const ExtractOptions &options, const std::string &manifestPath, double seconds)
+{
+    // Files in the manifest that should have been checked, but aren't in the archive
+    for (const auto &name : sink.manifestEntries()) {
+        if (archive.findEntry(name) == nullptr && shouldExtractFile(name, options.regexesToMatch, options.regexesNotToMatch))
+            sink.addFailure(name, "Missing from the archive.");
+    }
+
+    if (!manifestPath.empty())
+        sink.writeManifest(manifestPath);
+
+    std::cout.clear();
+    const auto failures = sink.failures();
+
+    for (const auto &failure : failures)
+        std::cout << "\nCORRUPT: " << failure.name << ": " << failure.error;
+
+    // Decompression speed per core counts only the time threads spent decoding
+    double decompressSeconds;
+    uint64_t decompressedBytes;
+    phaseTotals(Phase::Decompress, decompressSeconds, decompressedBytes);
+
+    auto precision = std::cout.precision();
+    std::cout << "\n" << failures.size() << " corrupt files, " << std::fixed << std::setprecision(1)
+        << sink.bytesVerified() / (1024.0 * 1024) << " MB verified at " << sink.bytesVerified() / seconds / (1024 * 1024) << " MB/s";
+
+    if (decompressSeconds > 0)
+        std::cout << ", decompressing at " << decompressedBytes / decompressSeconds / (1024 * 1024) << " MB/s per core";
+
+    std::cout << '.' << std::defaultfloat << std::setprecision(precision) << std::endl;
+    return failures.empty() ? 0 : 1;
+}
+
 int main(int argc, char **argv)
 {
     // Disable sync with stdio
@@ -17,24 +262,109 @@ int main(int argc, char **argv)
     std::array<char, 8192> buffer;
     std::cout.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
 
-    std::cout << "EternalResourceExtractor v4.0.0 by powerball253\n\n";
-
     // Parse arguments
     argh::parser cmdl;
-    cmdl.add_params({"-f", "--filter", "-r", "--regex"});
+    cmdl.add_params({"-f", "--filter", "-r", "--regex", "--tar", "--blob", "-t", "--threads", "--serve", "--cache", "--stats-json", "--max-memory", "--pack", "--level", "--manifest", "--write-manifest", "--shard", "--type", "--hook", "--hash", "--debounce", "--where", "--priority", "--notify", "--tune-cache"});
     cmdl.parse(argc, argv);
 
+    // Keep stdout clean when streaming the tar archive to it
+    const std::string tarPath = cmdl("--tar").str();
+
+    if (tarPath == "-")
+        std::cout.rdbuf(std::cerr.rdbuf());
+
+    const std::string blobPath = cmdl("--blob").str();
+    const bool verify = cmdl["--verify"];
+    const bool plan = cmdl["--plan"];
+    const bool listTypes = cmdl["--types"];
+    const bool noWrite = cmdl["--no-write"];
+    const bool raw = cmdl["--raw"];
+    const bool inflateRaw = cmdl["--inflate-raw"];
+    const bool watch = cmdl["--watch"];
+    const bool resume = cmdl["--resume"];
+    const bool sparse = cmdl["--sparse"];
+    const bool needsOutDirectory = (tarPath.empty() && blobPath.empty() && !verify && !plan && !listTypes && !noWrite) || watch;
+
+    std::cout << "EternalResourceExtractor v4.0.0 by powerball253\n\n";
+
     if (cmdl[{"-h", "--help"}]) {
         std::cout << "Usage:\n";
         std::cout << "EternalResourceExtractor [path to .resources file] [out path] [options]\n\n";
         std::cout << "Options:\n\n";
         std::cout << "-h, --help\t\tDisplay this help message and exit\n\n";
         std::cout << "-q, --quiet\t\tSilences output during the extraction process.\n\n";
+        std::cout << "-p, --progress\t\tShow a single progress line with files, bytes, speed and ETA instead\n"
+            << "\t\t\tof a line for each extracted file.\n\n";
         std::cout << "-f, --filter=FILTERS\tIndicate a pattern the filename must match to be extracted, using\n"
             << "\t\t\t'*' for matching various characters and '?' to match exactly one.\n";
         std::cout << "\t\t\tYou can also prepend a '!' at the beginning of a filter to indicate it\n"
         << "\t\t\tmust not be matched, and separate various filters with a ';'.\n\n";
         std::cout << "-r, --regex=REGEXES\tSimilar to -f, but allows full regular expressions to be passed.\n\n";
+        std::cout << "--tar=FILE\t\tStream the extracted files into a tar archive instead of the out\n"
+            << "\t\t\tdirectory, in data offset order. Use '-' to write it to stdout.\n\n";
+        std::cout << "--blob=FILE\t\tWrite the extracted files into a single aligned blob file, plus a\n"
+            << "\t\t\tFILE.idx hash index for looking them up by name.\n\n";
+        std::cout << "--verify\t\tDecompress the files without writing them, checking their sizes, and\n"
+            << "\t\t\treport the corrupt ones along with the decompression speed.\n\n";
+        std::cout << "--manifest=FILE\t\tWith --verify, compare the checksum of each file with the ones listed\n"
+            << "\t\t\tin FILE, as written by --write-manifest.\n\n";
+        std::cout << "--write-manifest=FILE\tWith --verify, write the XXH64 checksum of each file to FILE.\n\n";
+        std::cout << "--raw\t\t\tCopy the files out still compressed, as they're stored in the archive,\n"
+            << "\t\t\tinto .eraw files that can be extracted like archives later on.\n\n";
+        std::cout << "--inflate-raw\t\tDecompress every .eraw file under the directory given instead of the\n"
+            << "\t\t\t.resources file, extracting them like the entries of an archive.\n\n";
+        std::cout << "--watch\t\t\tKeep an extracted mirror of every archive under the directory given\n"
+            << "\t\t\tinstead of the .resources file up to date, extracting only the files\n"
+            << "\t\t\tthat changed when an archive is patched (Linux only).\n\n";
+        std::cout << "--debounce=MS\t\tTime an archive must stop changing for before --watch updates its\n"
+            << "\t\t\tmirror (default: 2000).\n\n";
+        std::cout << "--watch-checksums\tAlso compare checksums of the stored data with --watch, to catch\n"
+            << "\t\t\tfiles patched in place with the same sizes, hashing every file on\n"
+            << "\t\t\teach update.\n\n";
+        std::cout << "--where=CONDITION\tOnly extract files whose sizes, compression ratio or offset match the\n"
+            << "\t\t\tcondition, checked on the index without reading any data, e.g.\n"
+            << "\t\t\t\"size<1M and compressed\" or \"not (zsize>500M or ratio<0.2)\".\n\n";
+        std::cout << "--priority=FILTERS\tExtract the files matching the given filters first, in the order of\n"
+            << "\t\t\tthe filters, separated with a ';' like in -f.\n\n";
+        std::cout << "--notify=FD|FILE\tWrite a line to the given file descriptor, pipe or file as soon as\n"
+            << "\t\t\teach file is extracted, and once all files matching each --priority\n"
+            << "\t\t\tfilter are.\n\n";
+        std::cout << "--type=TYPES\t\tOnly extract files of the given types, detected from their first bytes\n"
+            << "\t\t\tinstead of their names, separated with a ';', e.g. dds-bc7;decl.\n\n";
+        std::cout << "--types\t\t\tShow how many files of each type there are and exit without extracting.\n\n";
+        std::cout << "--hook=PLUGIN[;ARGS]\tPass every decompressed file to a plugin implementing the C interface\n"
+            << "\t\t\tin eternal_hook.h before writing it, which may skip the write. ARGS\n"
+            << "\t\t\tare passed to the plugin, and it can be given more than once.\n\n";
+        std::cout << "--hash=FILE\t\tWrite the XXH64 checksum of each extracted file to FILE, in the same\n"
+            << "\t\t\tformat as --write-manifest.\n\n";
+        std::cout << "--no-write\t\tOnly pass the files to --hook and --hash, without writing them.\n\n";
+        std::cout << "--resume\t\tWrite every file under a temporary name and only give it its own once\n"
+            << "\t\t\tcomplete, keeping a journal of the extracted files in the out\n"
+            << "\t\t\tdirectory, so an interrupted extraction run again with --resume skips\n"
+            << "\t\t\tthe files already extracted.\n\n";
+        std::cout << "--sparse\t\tSkip writing blocks of zeros in the extracted files, leaving holes the\n"
+            << "\t\t\tfilesystem doesn't store, and show the bytes written to disk.\n\n";
+        std::cout << "--shard=I/N\t\tSplit the files matching the filters into N shards of about equal size,\n"
+            << "\t\t\tthe same on every machine, and only extract shard I (1 to N).\n\n";
+        std::cout << "--plan\t\t\tShow the files and bytes in each --shard and exit without extracting.\n\n";
+        std::cout << "-t, --threads=N\t\tNumber of threads to extract with (default: 1). With 'auto', every core\n"
+            << "\t\t\tis used, and how many files are extracted at once is tuned during the\n"
+            << "\t\t\tfirst seconds by measuring throughput, the other threads helping\n"
+            << "\t\t\tdecompress large files.\n\n";
+        std::cout << "--tune-cache=FILE\tWith -t auto, reuse the settings tuned for the output device in FILE\n"
+            << "\t\t\tinstead of tuning again, or store them there once tuned.\n\n";
+        std::cout << "--max-memory=SIZE\tLimit the memory used by decompression buffers in flight, e.g. 2G.\n"
+            << "\t\t\tFiles larger than the limit run alone, decompressed in a stream\n"
+            << "\t\t\tthrough a buffer of that size when their matches allow it.\n\n";
+        std::cout << "--stats-json=FILE\tWrite per-phase timings, latency histograms and resource usage\n"
+            << "\t\t\tof the extraction to a JSON file.\n\n";
+        std::cout << "--serve=SOCKET\t\tKeep the given archives loaded and serve their files over a Unix\n"
+            << "\t\t\tdomain socket, answering requests on the -t threads. All positional\n"
+            << "\t\t\targuments are taken as archives in this mode.\n\n";
+        std::cout << "--cache=MB\t\tMemory budget for decompressed files cached by --serve (default: 512).\n\n";
+        std::cout << "--pack=FILE\t\tPack every file under the directory given as the first positional\n"
+            << "\t\t\targument into a new .resources file, compressing on the -t threads.\n\n";
+        std::cout << "--level=N\t\tKraken compression level for --pack, 1 to 7 (default: 4).\n\n";
         std::cout.flush();
         return 1;
     }
@@ -42,6 +372,44 @@ int main(int argc, char **argv)
     if (cmdl[{"-q", "--quiet"}])
         std::cout.setstate(std::ios::failbit); // Makes cout not output anything
 
+    // Get thread count
+    unsigned int threadCount;
+    const bool autoThreads = cmdl({"-t", "--threads"}).str() == "auto";
+
+    if (autoThreads)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1U);
+    else if (!(cmdl({"-t", "--threads"}, 1) >> threadCount) || threadCount == 0)
+        throwError("Invalid thread count: " + cmdl({"-t", "--threads"}).str());
+
+    if (cmdl("--tune-cache") && !autoThreads)
+        throwError("--tune-cache needs -t auto.");
+
+    // Serve the archives instead of extracting them
+    const std::string socketPath = cmdl("--serve").str();
+
+    if (!socketPath.empty()) {
+        size_t cacheMegabytes;
+
+        if (!(cmdl("--cache", 512) >> cacheMegabytes))
+            throwError("Invalid cache size: " + cmdl("--cache").str());
+
+        const std::vector<std::string> archivePaths(cmdl.pos_args().begin() + 1, cmdl.pos_args().end());
+        return serveArchives(archivePaths, socketPath, threadCount, cacheMegabytes * 1024 * 1024);
+    }
+
+    // Pack a directory instead of extracting
+    const std::string packPath = cmdl("--pack").str();
+
+    if (!packPath.empty()) {
+        PackOptions packOptions;
+        packOptions.threadCount = threadCount;
+
+        if (!(cmdl("--level", packOptions.level) >> packOptions.level) || packOptions.level < 1 || packOptions.level > MAX_PACK_LEVEL)
+            throwError("Invalid compression level: " + cmdl("--level").str());
+
+        return packArchive(cmdl.pos_args(), packPath, packOptions, cmdl[{"-q", "--quiet"}], cmdl[{"-p", "--progress"}]);
+    }
+
     // Get resource & out path
     const std::vector<std::string> args = cmdl.pos_args();
     std::string resourcePath;
@@ -54,20 +422,24 @@ int main(int argc, char **argv)
             std::cout.flush();
             std::getline(std::cin, resourcePath);
 
-            std::cout << "Input the path to the out directory: ";
-            std::cout.flush();
-            std::getline(std::cin, outPath);
+            if (needsOutDirectory) {
+                std::cout << "Input the path to the out directory: ";
+                std::cout.flush();
+                std::getline(std::cin, outPath);
+            }
 
             std::cout << '\n';
             break;
         case 2:
             resourcePath = args[1];
 
-            std::cout << "Input the path to the out directory: ";
-            std::cout.flush();
-            std::getline(std::cin, outPath);
+            if (needsOutDirectory) {
+                std::cout << "Input the path to the out directory: ";
+                std::cout.flush();
+                std::getline(std::cin, outPath);
+                std::cout << '\n';
+            }
 
-            std::cout << '\n';
             break;
         default:
             resourcePath = args[1];
@@ -79,7 +451,7 @@ int main(int argc, char **argv)
     if (resourcePath.empty())
         throwError("Resource file was not specified.");
 
-    if (outPath.empty())
+    if (outPath.empty() && needsOutDirectory)
         throwError("Out directory was not specified.");
 
     resourcePath = fs::absolute(formatPath(resourcePath), ec).string();
@@ -87,62 +459,355 @@ int main(int argc, char **argv)
     if (ec.value() != 0)
         throwError("Failed to get resource path: " + ec.message());
 
-    outPath = fs::absolute(formatPath(outPath), ec).string();
+    if (needsOutDirectory) {
+        outPath = fs::absolute(formatPath(outPath), ec).string();
 
-    if (ec.value() != 0)
-        throwError("Failed to get out path: " + ec.message());
+        if (ec.value() != 0)
+            throwError("Failed to get out path: " + ec.message());
 
-    if (outPath[outPath.length() - 1] != fs::path::preferred_separator)
-        outPath.push_back(fs::path::preferred_separator);
+        if (outPath[outPath.length() - 1] != fs::path::preferred_separator)
+            outPath.push_back(fs::path::preferred_separator);
 
 #ifdef _WIN32
-    // "\\?\" alongside the wide string functions is used to bypass PATH_MAX
-    // Check https://docs.microsoft.com/en-us/windows/win32/fileio/maximum-file-path-limitation?tabs=cmd for details
-    outPath = "\\\\?\\" + outPath;
+        // "\\?\" alongside the wide string functions is used to bypass PATH_MAX
+        // Check https://docs.microsoft.com/en-us/windows/win32/fileio/maximum-file-path-limitation?tabs=cmd for details
+        outPath = "\\\\?\\" + outPath;
 #endif
+    }
 
     // Get regexes to match/not match
-    std::vector<std::regex> regexesToMatch;
-    std::vector<std::regex> regexesNotToMatch;
-    compileRegexes(regexesToMatch, regexesNotToMatch, cmdl.params());
+    ExtractOptions options;
+    options.threadCount = threadCount;
+    options.raw = raw;
+
+    if (cmdl("--max-memory") && !parseSize(cmdl("--max-memory").str(), options.maxMemory))
+        throwError("Invalid memory budget: " + cmdl("--max-memory").str());
+
+    try {
+        compileRegexes(options.regexesToMatch, options.regexesNotToMatch, cmdl.params());
+    }
+    catch (const ResourceError &e) {
+        throwError(e.what());
+    }
+
+    // Get the condition on the files' index metadata
+    if (cmdl("--where")) {
+        try {
+            options.where = EntryPredicate(cmdl("--where").str());
+        }
+        catch (const ResourceError &e) {
+            throwError(e.what());
+        }
+    }
+
+    // Get the types of files to extract
+    if (cmdl("--type"))
+        options.types = splitString(cmdl("--type").str(), ';');
+
+    // Get the shard of the files to extract on this machine
+    if (cmdl("--shard")) {
+        const std::vector<std::string> shard = splitString(cmdl("--shard").str(), '/');
+
+        if (shard.size() != 2 || !(std::istringstream(shard[0]) >> options.shardIndex) || !(std::istringstream(shard[1]) >> options.shardCount)
+        || options.shardCount == 0 || options.shardIndex == 0 || options.shardIndex > options.shardCount)
+            throwError("Invalid shard: " + cmdl("--shard").str());
+
+        options.shardIndex--;
+    }
+    else if (plan) {
+        throwError("--plan needs the number of shards, e.g. --shard=1/4.");
+    }
+
+    if (raw && (verify || inflateRaw))
+        throwError("--raw can't be used with --verify or --inflate-raw.");
+
+    if (resume && (!tarPath.empty() || !blobPath.empty() || verify || noWrite || raw || watch || cmdl("--hash")))
+        throwError("--resume can only be used when extracting into the out directory, without --raw or --hash.");
+
+    if (sparse && (!tarPath.empty() || !blobPath.empty() || verify || noWrite || watch))
+        throwError("--sparse can only be used when extracting into the out directory.");
+
+    // Raw files don't keep the offset their data had in the archive
+    if (inflateRaw && options.where.usesField(PredicateInstruction::Field::Offset))
+        throwError("--where can't test the offset with --inflate-raw.");
+
+    // Get the files to extract first
+    std::vector<std::string> priorityFilters;
+
+    if (cmdl("--priority")) {
+        priorityFilters = splitString(cmdl("--priority").str(), ';');
+
+        for (const auto &filter : priorityFilters) {
+            try {
+                options.priorities.emplace_back(filterToRegex(filter), std::regex_constants::ECMAScript | std::regex_constants::optimize);
+            }
+            catch (const std::exception &e) {
+                throwError("Failed to parse " + filter + " priority filter: " + e.what());
+            }
+        }
+    }
+
+    // Announce extracted files to other tools
+    CompletionNotifier *notifier = nullptr;
+
+    if (cmdl("--notify")) {
+#ifndef _WIN32
+        // Keep extracting if the reader goes away
+        signal(SIGPIPE, SIG_IGN);
+#endif
+
+        try {
+            notifier = new CompletionNotifier(cmdl("--notify").str(), priorityFilters);
+        }
+        catch (const ResourceError &e) {
+            throwError(e.what());
+        }
+
+        options.notifier = notifier;
+    }
+
+    // Keep a mirror of the archives under the directory up to date instead of extracting a single one
+    if (watch) {
+        unsigned int debounceMilliseconds;
+
+        if (!(cmdl("--debounce", WATCH_DEBOUNCE_MS) >> debounceMilliseconds))
+            throwError("Invalid debounce time: " + cmdl("--debounce").str());
+
+        if (!tarPath.empty() || !blobPath.empty() || verify || plan || listTypes || noWrite || raw || inflateRaw)
+            throwError("--watch can only extract into the out directory.");
+
+        return watchArchives(resourcePath, outPath, options, debounceMilliseconds, cmdl["--watch-checksums"]);
+    }
+
+    // Report progress from a separate thread unless silenced
+    ProgressReporter *progress = nullptr;
+
+    if (!cmdl[{"-q", "--quiet"}]) {
+#ifdef _WIN32
+        bool terminal = _isatty(_fileno(tarPath == "-" ? stderr : stdout));
+#else
+        bool terminal = isatty(tarPath == "-" ? STDERR_FILENO : STDOUT_FILENO);
+#endif
+        progress = new ProgressReporter(cmdl[{"-p", "--progress"}] ? ProgressMode::Bar : ProgressMode::Log, std::cout, terminal, verify ? "Verifying" : raw ? "Copying" : "Extracting");
+        options.progress = progress;
+    }
+
+    // Enable instrumentation before anything is timed
+    const std::string statsPath = cmdl("--stats-json").str();
+    statsEnabled = !statsPath.empty() || verify;
 
     // Time program
     chrono::steady_clock::time_point begin = chrono::steady_clock::now();
 
-    // Open the resource file
-    MemoryMappedFile *memoryMappedFile;
+    // Open the resource file, or the raw files under the directory as a single archive
+    ResourceArchive *archive = nullptr;
 
     try {
-        memoryMappedFile = new MemoryMappedFile(resourcePath);
+        archive = inflateRaw ? new ResourceArchive(findRawFiles(resourcePath)) : new ResourceArchive(resourcePath);
     }
-    catch (const std::exception &e) {
-        throwError("Failed to open " + resourcePath + " for reading.");
+    catch (const ResourceError &e) {
+        throwError(e.what());
     }
     
-    // Create out path
-    fs::create_directories(outPath, ec);
+    // Show how the files are split up instead of extracting them
+    if (plan) {
+        printShardPlan(planShards(*archive, options), options.shardIndex);
+        delete progress;
+        delete archive;
+        delete notifier;
+        return 0;
+    }
 
-    if (ec.value() != 0)
-        throwError("Failed to create out directory: " + ec.message());
+    // Show the types of the files instead of extracting them
+    if (listTypes) {
+        printTypes(*archive, options);
+        delete progress;
+        delete archive;
+        delete notifier;
+        return 0;
+    }
+
+    // Skip the files extracted by an interrupted run
+    ExtractJournal *journal = nullptr;
+
+    if (resume) {
+        fs::create_directories(outPath, ec);
+
+        if (ec.value() != 0)
+            throwError("Failed to create out directory: " + ec.message());
+
+        try {
+            journal = new ExtractJournal(outPath + "." + fs::path(resourcePath).filename().string() + ".journal", *archive);
+        }
+        catch (const ResourceError &e) {
+            throwError(e.what());
+        }
+
+        if (journal->completedCount() != 0)
+            std::cout << "Resuming, " << journal->completedCount() << " files already extracted.\n\n";
+
+        options.journal = journal;
+    }
+
+    // Open the output
+    OutputSink *sink = nullptr;
+    VerifySink *verifySink = nullptr;
+    DirectorySink *directorySink = nullptr;
+
+    try {
+        if (noWrite) {
+            if (verify || !tarPath.empty() || !blobPath.empty())
+                throwError("--no-write can't be used with --verify, --tar or --blob.");
+        }
+        else if (verify) {
+            verifySink = new VerifySink(!cmdl("--write-manifest").str().empty());
+
+            if (cmdl("--manifest"))
+                verifySink->loadManifest(cmdl("--manifest").str());
+
+            sink = verifySink;
+        }
+        else if (!tarPath.empty()) {
+            sink = new TarSink(tarPath);
+        }
+        else if (!blobPath.empty()) {
+            sink = new BlobSink(blobPath);
+        }
+        else {
+            // Create out path
+            fs::create_directories(outPath, ec);
+
+            if (ec.value() != 0)
+                throwError("Failed to create out directory: " + ec.message());
+
+            directorySink = new DirectorySink(outPath, resume, sparse);
+            sink = directorySink;
+        }
+    }
+    catch (const ResourceError &e) {
+        throwError(e.what());
+    }
+
+    // Pass the files through the hooks before they're written
+    std::vector<std::unique_ptr<FileHook>> hooks;
+
+    try {
+        for (const auto &param : cmdl.params()) {
+            if (param.first != "hook")
+                continue;
+
+            size_t separator = param.second.find(';');
+            hooks.emplace_back(new PluginHook(param.second.substr(0, separator), separator == std::string::npos ? "" : param.second.substr(separator + 1)));
+        }
 
+        if (cmdl("--hash"))
+            hooks.emplace_back(new ChecksumHook(cmdl("--hash").str()));
+    }
+    catch (const ResourceError &e) {
+        throwError(e.what());
+    }
+
+    if (noWrite && hooks.empty())
+        throwError("--no-write needs --hook or --hash.");
+
+    HookSink *hookSink = hooks.empty() ? nullptr : new HookSink(std::move(hooks), sink);
+    OutputSink *output = hookSink != nullptr ? hookSink : sink;
     size_t filesExtracted = 0;
 
-    // Identify file using magic and extract
-    if (memcmp(memoryMappedFile->memp, "IDCL", 4) == 0)
-        filesExtracted = extractResource(memoryMappedFile, outPath, regexesToMatch, regexesNotToMatch);
-    else if (*reinterpret_cast<uint32_t*>(memoryMappedFile->memp) == 131121354)
-        filesExtracted = extractWad7(memoryMappedFile, outPath, regexesToMatch, regexesNotToMatch);
-    else
-        throwError(fs::path(resourcePath).filename().string() + " is not a valid .resources or .wad7 file.");
+    // Tune how many files are extracted at once, unless it was already done for the output device
+    WorkerTuner *tuner = nullptr;
+    const std::string tuneCachePath = cmdl("--tune-cache").str();
+    std::string device;
+    unsigned int cachedWorkers = 0;
+
+    if (autoThreads) {
+        if (!tuneCachePath.empty()) {
+            device = noWrite || verify ? "none" : tarPath == "-" ? "stdout" : outputDevice(!tarPath.empty() ? tarPath : !blobPath.empty() ? blobPath : outPath);
+            cachedWorkers = loadTunedWorkers(tuneCachePath, device, threadCount);
+
+            if (cachedWorkers != 0)
+                std::cout << "Using " << cachedWorkers << " of " << threadCount << " threads to extract files at once, as tuned for this device.\n\n";
+        }
+
+        tuner = new WorkerTuner(threadCount, cachedWorkers);
+        options.tuner = tuner;
+    }
+
+    // Extract files
+    try {
+        filesExtracted = extractFiles(*archive, *output, options);
+    }
+    catch (const ResourceError &e) {
+        throwError(e.what());
+    }
+
+    // Report the tuned settings, and keep them for the next run on the same device
+    if (tuner != nullptr && cachedWorkers == 0) {
+        TuningResult tuning = tuner->result();
 
-    delete memoryMappedFile;
+        std::cout << "\nTuned to " << tuning.workers << " of " << tuning.threadCount << " threads extracting files at once" << (tuning.settled ? "" : " (extraction ended before tuning did)")
+            << ", the rest helping decompress large files. Workers spent " << static_cast<int>(tuning.decompressShare * 100) << "% of their time decompressing and "
+            << static_cast<int>(tuning.writeShare * 100) << "% writing." << std::endl;
+
+        if (tuning.settled && !tuneCachePath.empty()) {
+            try {
+                saveTunedWorkers(tuneCachePath, device, threadCount, tuning.workers);
+            }
+            catch (const ResourceError &e) {
+                throwError(e.what());
+            }
+        }
+    }
+
+    // Show how much of the files' data was left out as holes
+    if (sparse) {
+        uint64_t holeBytes = directorySink->bytesLogical() - directorySink->bytesWritten();
+        auto precision = std::cout.precision();
+
+        std::cout << "\nWrote " << std::fixed << std::setprecision(1) << directorySink->bytesWritten() / (1024.0 * 1024) << " MB for "
+            << directorySink->bytesLogical() / (1024.0 * 1024) << " MB of files, leaving " << holeBytes / (1024.0 * 1024) << " MB of zeros as holes."
+            << std::defaultfloat << std::setprecision(precision) << std::endl;
+    }
+
+    // Every file was extracted, there's nothing left to resume
+    if (journal != nullptr)
+        journal->remove();
+
+    delete progress;
 
     // Exit
     chrono::steady_clock::time_point end = chrono::steady_clock::now();
     double totalTime = static_cast<double>(chrono::duration_cast<chrono::microseconds>(end - begin).count());
     double totalTimeSeconds = totalTime / 1000000;
+    int exitCode = 0;
+
+    if (verify) {
+        try {
+            exitCode = reportVerification(*archive, *verifySink, options, cmdl("--write-manifest").str(), totalTimeSeconds);
+        }
+        catch (const ResourceError &e) {
+            throwError(e.what());
+        }
+    }
+
+    delete hookSink;
+    delete sink;
+    delete archive;
+    delete notifier;
+    delete journal;
+    delete tuner;
+
+    if (!statsPath.empty()) {
+        try {
+            writeStatsJson(statsPath, resourcePath, totalTimeSeconds);
+        }
+        catch (const ResourceError &e) {
+            throwError(e.what());
+        }
+    }
 
     std::cout.clear();
-    std::cout << "\nDone, " << filesExtracted << " files extracted in " << totalTimeSeconds << " seconds." << std::endl;
+    std::cout << "\nDone, " << filesExtracted << " files " << (verify ? "verified" : "extracted") << " in " << totalTimeSeconds << " seconds." << std::endl;
     pressAnyKey();
+    return exitCode;
 }
@@ -23,6 +23,8 @@ MemoryMappedFile::MemoryMappedFile(const fs::path &path, size_t size, bool creat
     if (size <= 0)
         throw std::exception();
 
+    this->size = size;
+
 #ifdef _WIN32
     // Open the file
     fileHandle = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, (create ? CREATE_ALWAYS : OPEN_EXISTING), (sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL), nullptr);
@@ -56,7 +58,8 @@ MemoryMappedFile::MemoryMappedFile(const fs::path &path, size_t size, bool creat
     // Map the file to memory
     memp = reinterpret_cast<unsigned char*>(mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0));
 
-    if (memp == nullptr) {
+    if (memp == MAP_FAILED) {
+        memp = nullptr;
         close(fileDescriptor);
         throw std::exception();
     }
@@ -0,0 +1,163 @@
+#define FUSE_USE_VERSION 31
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <fuse.h>
+#include "vfs.hpp"
+#include "utils.hpp"
+#include "argh/argh.h"
+
+// Get the filesystem passed to fuse_main
+static ResourceFilesystem *getFilesystem()
+{
+    return static_cast<ResourceFilesystem*>(fuse_get_context()->private_data);
+}
+
+// Fill stat struct from filesystem metadata
+static void fillStat(const VfsStat &vfsStat, struct stat *st)
+{
+    memset(st, 0, sizeof(*st));
+    st->st_mode = vfsStat.isDirectory ? (S_IFDIR | 0555) : (S_IFREG | 0444);
+    st->st_nlink = vfsStat.isDirectory ? 2 : 1;
+    st->st_size = static_cast<off_t>(vfsStat.size);
+}
+
+static int fsGetattr(const char *path, struct stat *st, struct fuse_file_info *)
+{
+    VfsStat vfsStat;
+
+    if (!getFilesystem()->stat(path, vfsStat))
+        return -ENOENT;
+
+    fillStat(vfsStat, st);
+    return 0;
+}
+
+static int fsReaddir(const char *path, void *buf, fuse_fill_dir_t filler, off_t, struct fuse_file_info *, enum fuse_readdir_flags)
+{
+    std::vector<std::pair<std::string, VfsStat>> children;
+
+    if (!getFilesystem()->listDirectory(path, children))
+        return -ENOTDIR;
+
+    filler(buf, ".", nullptr, 0, static_cast<fuse_fill_dir_flags>(0));
+    filler(buf, "..", nullptr, 0, static_cast<fuse_fill_dir_flags>(0));
+
+    for (const auto &child : children) {
+        struct stat st;
+        fillStat(child.second, &st);
+
+        if (filler(buf, child.first.c_str(), &st, 0, static_cast<fuse_fill_dir_flags>(0)) != 0)
+            break;
+    }
+
+    return 0;
+}
+
+static int fsOpen(const char *path, struct fuse_file_info *fi)
+{
+    if ((fi->flags & O_ACCMODE) != O_RDONLY)
+        return -EROFS;
+
+    VfsStat vfsStat;
+
+    if (!getFilesystem()->stat(path, vfsStat))
+        return -ENOENT;
+
+    if (vfsStat.isDirectory)
+        return -EISDIR;
+
+    try {
+        fi->fh = reinterpret_cast<uint64_t>(new VfsFile(getFilesystem()->open(path)));
+    }
+    catch (const std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return -EIO;
+    }
+
+    fi->keep_cache = 1;
+    return 0;
+}
+
+static int fsRead(const char *, char *buf, size_t size, off_t offset, struct fuse_file_info *fi)
+{
+    const auto *file = reinterpret_cast<VfsFile*>(fi->fh);
+
+    if (offset < 0 || static_cast<uint64_t>(offset) >= file->size)
+        return 0;
+
+    size = static_cast<size_t>(std::min<uint64_t>(size, file->size - offset));
+    memcpy(buf, file->data + offset, size);
+    return static_cast<int>(size);
+}
+
+static int fsRelease(const char *, struct fuse_file_info *fi)
+{
+    delete reinterpret_cast<VfsFile*>(fi->fh);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    // Parse arguments
+    argh::parser cmdl;
+    cmdl.add_params({"-c", "--cache"});
+    cmdl.parse(argc, argv);
+
+    const std::vector<std::string> args = cmdl.pos_args();
+
+    if (cmdl[{"-h", "--help"}] || args.size() < 3) {
+        std::cout << "Usage:\n";
+        std::cout << "EternalResourceFS [.resources/.wad7 files...] [mount point] [options]\n\n";
+        std::cout << "Options:\n\n";
+        std::cout << "-h, --help\t\tDisplay this help message and exit\n\n";
+        std::cout << "-c, --cache=MB\t\tMemory budget for cached decompressed files (default: 512).\n\n";
+        std::cout << "-f, --foreground\tStay in the foreground instead of daemonizing.\n\n";
+        std::cout << "Files in later archives replace files with the same path in earlier ones.\n";
+        std::cout.flush();
+        return 1;
+    }
+
+    size_t cacheMegabytes;
+
+    if (!(cmdl({"-c", "--cache"}, 512) >> cacheMegabytes))
+        throwError("Invalid cache size: " + cmdl({"-c", "--cache"}).str());
+
+    // Load archive indexes
+    std::vector<std::unique_ptr<ResourceArchive>> archives;
+    ResourceFilesystem filesystem(cacheMegabytes * 1024 * 1024);
+
+    for (size_t i = 1; i < args.size() - 1; i++) {
+        try {
+            archives.emplace_back(new ResourceArchive(fs::absolute(formatPath(args[i]))));
+        }
+        catch (const ResourceError &e) {
+            throwError(e.what());
+        }
+
+        filesystem.addArchive(*archives.back());
+    }
+
+    // Mount read-only
+    std::vector<std::string> fuseArgs = {args[0], args.back(), "-o", "ro,default_permissions"};
+
+    if (cmdl[{"-f", "--foreground"}])
+        fuseArgs.emplace_back("-f");
+
+    std::vector<char*> fuseArgv;
+
+    for (auto &arg : fuseArgs)
+        fuseArgv.push_back(&arg[0]);
+
+    struct fuse_operations operations = {};
+    operations.getattr = fsGetattr;
+    operations.readdir = fsReaddir;
+    operations.open = fsOpen;
+    operations.read = fsRead;
+    operations.release = fsRelease;
+
+    return fuse_main(static_cast<int>(fuseArgv.size()), fuseArgv.data(), &operations, &filesystem);
+}
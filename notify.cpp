@@ -0,0 +1,169 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include "notify.hpp"
+
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
+// CompletionNotifier constructor, target is a file descriptor number or a path to a pipe or file
+CompletionNotifier::CompletionNotifier(const std::string &target, const std::vector<std::string> &patterns) : target(target), patterns(patterns)
+{
+    if (!target.empty() && target.find_first_not_of("0123456789") == std::string::npos) {
+        descriptor = std::stoi(target);
+        ownsDescriptor = false;
+        return;
+    }
+
+    // Opening a named pipe waits for the reader
+#ifdef _WIN32
+    descriptor = _wopen(fs::path(target).c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    descriptor = open(target.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+#endif
+
+    if (descriptor == -1)
+        throw ResourceError("Failed to open " + target + " for notifications: " + strerror(errno));
+
+    ownsDescriptor = true;
+}
+
+// CompletionNotifier destructor
+CompletionNotifier::~CompletionNotifier()
+{
+    stopWriter();
+
+    if (!ownsDescriptor)
+        return;
+
+#ifdef _WIN32
+    _close(descriptor);
+#else
+    close(descriptor);
+#endif
+}
+
+// Write a line, giving up on notifications for good if the reader went away
+void CompletionNotifier::writeLine(const std::string &line)
+{
+    if (broken)
+        return;
+
+    const char *data = line.c_str();
+    size_t remaining = line.length();
+
+    while (remaining > 0) {
+#ifdef _WIN32
+        int written = _write(descriptor, data, static_cast<unsigned int>(remaining));
+#else
+        ssize_t written = write(descriptor, data, remaining);
+#endif
+
+        if (written == -1 && errno == EINTR)
+            continue;
+
+        if (written <= 0) {
+            broken = true;
+            return;
+        }
+
+        data += written;
+        remaining -= written;
+    }
+}
+
+// Write the queued lines on the writer thread until stopped, once every line is written
+void CompletionNotifier::writeLines()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        linesQueued.wait(lock, [this]() { return stopping || !queuedLines.empty(); });
+
+        if (queuedLines.empty())
+            return;
+
+        std::deque<std::string> lines;
+        lines.swap(queuedLines);
+        lock.unlock();
+
+        for (const auto &line : lines)
+            writeLine(line);
+
+        lock.lock();
+    }
+}
+
+// Write the remaining lines and stop the writer thread
+void CompletionNotifier::stopWriter()
+{
+    if (!writerThread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    linesQueued.notify_one();
+    writerThread.join();
+}
+
+// Queue a line for the writer thread, called with the lock held
+void CompletionNotifier::announce(const std::string &line)
+{
+    queuedLines.push_back(line);
+    linesQueued.notify_one();
+}
+
+// Announce a finished batch
+void CompletionNotifier::batchDone(size_t batch)
+{
+    announce("BATCH " + std::to_string(batch + 1) + ' ' + patterns[batch] + '\n');
+}
+
+// Set the number of files in each priority batch, announcing the empty ones right away
+// Files past the last batch are the ones that matched no pattern, and aren't announced as a batch
+// Each extraction is started and finished in turn, as --watch extracts every update with the same notifier
+void CompletionNotifier::start(const std::vector<size_t> &batchSizes)
+{
+    stopWriter();
+    stopping = false;
+    writerThread = std::thread(&CompletionNotifier::writeLines, this);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    remainingFiles = batchSizes;
+    remainingFiles.resize(patterns.size(), 0);
+
+    for (size_t batch = 0; batch < patterns.size(); batch++) {
+        if (remainingFiles[batch] == 0)
+            batchDone(batch);
+    }
+}
+
+// Announce a file once it's written, and its batch once it was the last one left in it
+void CompletionNotifier::fileDone(const std::string &name, size_t batch, bool written)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (written)
+        announce("FILE " + name + '\n');
+
+    if (batch < remainingFiles.size() && --remainingFiles[batch] == 0)
+        batchDone(batch);
+}
+
+// Announce the end of the extraction, returning once every line is written
+void CompletionNotifier::finish(size_t fileCount)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        announce("END " + std::to_string(fileCount) + '\n');
+    }
+
+    stopWriter();
+}
@@ -0,0 +1,48 @@
+#ifndef NOTIFY_HPP
+#define NOTIFY_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "archive.hpp"
+
+// Announces files as soon as they're extracted on a pipe, file or inherited file descriptor, one line each:
+//   FILE <name>           the file was written
+//   BATCH <n> <pattern>   every file matching the nth priority pattern was written or failed
+//   END <count>           extraction finished, count being the number of files written
+// Lines are queued for a writer thread, so extraction never waits on a slow reader, and written one after another.
+class CompletionNotifier {
+public:
+    CompletionNotifier(const std::string &target, const std::vector<std::string> &patterns);
+    ~CompletionNotifier();
+
+    CompletionNotifier(const CompletionNotifier&) = delete;
+    CompletionNotifier &operator=(const CompletionNotifier&) = delete;
+
+    void start(const std::vector<size_t> &batchSizes);
+    void fileDone(const std::string &name, size_t batch, bool written);
+    void finish(size_t fileCount);
+private:
+    std::string target;
+    std::vector<std::string> patterns;
+    int descriptor;
+    bool ownsDescriptor;
+    bool broken = false;
+    std::vector<size_t> remainingFiles;
+    std::mutex mutex;
+    std::condition_variable linesQueued;
+    std::deque<std::string> queuedLines;
+    bool stopping = false;
+    std::thread writerThread;
+
+    void announce(const std::string &line);
+    void batchDone(size_t batch);
+    void writeLine(const std::string &line);
+    void writeLines();
+    void stopWriter();
+};
+
+#endif
@@ -0,0 +1,174 @@
+#include <atomic>
+#include "ooz.hpp"
+
+#ifdef OOZ_CPU_DISPATCH
+// Entry points of one ooz build, renamed by objcopy to ooz_<build>_<function> with every other symbol made local
+#define DECLARE_OOZ_BUILD(build) \
+    extern "C" int ooz_##build##_Kraken_Compress(uint8_t *src, size_t src_len, uint8_t *dst, int level); \
+    extern "C" int ooz_##build##_Kraken_Decompress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len); \
+    extern "C" KrakenDecoder *ooz_##build##_Kraken_Create(); \
+    extern "C" void ooz_##build##_Kraken_Destroy(KrakenDecoder *kraken); \
+    extern "C" bool ooz_##build##_Kraken_DecodeStep(KrakenDecoder *dec, uint8_t *dst_start, int offset, size_t dst_bytes_left_in, const uint8_t *src, size_t src_bytes_left);
+
+#define OOZ_BUILD(build, supported) \
+    {#build, supported, ooz_##build##_Kraken_Compress, ooz_##build##_Kraken_Decompress, ooz_##build##_Kraken_Create, \
+        ooz_##build##_Kraken_Destroy, ooz_##build##_Kraken_DecodeStep}
+
+// Entry points of a build and whether the CPU can run it
+struct OozBuild {
+    std::string name;
+    bool (*supported)();
+    int (*compress)(uint8_t*, size_t, uint8_t*, int);
+    int (*decompress)(const uint8_t*, size_t, uint8_t*, size_t);
+    KrakenDecoder *(*create)();
+    void (*destroy)(KrakenDecoder*);
+    bool (*decodeStep)(KrakenDecoder*, uint8_t*, int, size_t, const uint8_t*, size_t);
+};
+
+// Builds from source are compiled for these x86-64 microarchitecture levels
+static bool supportsBaseline()
+{
+    return true;
+}
+
+static bool supportsX86_64_V3()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi") && __builtin_cpu_supports("bmi2")
+        && __builtin_cpu_supports("fma");
+}
+
+static bool supportsX86_64_V4()
+{
+    __builtin_cpu_init();
+    return supportsX86_64_V3() && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+        && __builtin_cpu_supports("avx512cd") && __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl");
+}
+
+#ifdef OOZ_BUILD_AVX512
+DECLARE_OOZ_BUILD(avx512)
+#endif
+#ifdef OOZ_BUILD_AVX2
+DECLARE_OOZ_BUILD(avx2)
+#endif
+#ifdef OOZ_BUILD_GENERIC
+DECLARE_OOZ_BUILD(generic)
+#endif
+#ifdef OOZ_BUILD_PREBUILT
+DECLARE_OOZ_BUILD(prebuilt)
+#endif
+
+// Linked builds, from most to least preferred
+static const OozBuild allBuilds[] = {
+#ifdef OOZ_BUILD_AVX512
+    OOZ_BUILD(avx512, supportsX86_64_V4),
+#endif
+#ifdef OOZ_BUILD_AVX2
+    OOZ_BUILD(avx2, supportsX86_64_V3),
+#endif
+#ifdef OOZ_BUILD_GENERIC
+    OOZ_BUILD(generic, supportsBaseline),
+#endif
+#ifdef OOZ_BUILD_PREBUILT
+    OOZ_BUILD(prebuilt, supportsBaseline),
+#endif
+};
+
+// Pick the most preferred build the CPU supports
+static std::atomic<const OozBuild*> &activeBuild()
+{
+    static std::atomic<const OozBuild*> build([]() {
+        for (const auto &build : allBuilds) {
+            if (build.supported())
+                return &build;
+        }
+
+        return &allBuilds[0];
+    }());
+
+    return build;
+}
+
+// Get the names of the builds this CPU can run
+std::vector<std::string> oozBuilds()
+{
+    std::vector<std::string> names;
+
+    for (const auto &build : allBuilds) {
+        if (build.supported())
+            names.push_back(build.name);
+    }
+
+    return names;
+}
+
+// Get the name of the build in use
+const std::string &currentOozBuild()
+{
+    return activeBuild().load()->name;
+}
+
+// Use the given build from now on, returns false if it isn't linked in or the CPU can't run it
+bool selectOozBuild(const std::string &name)
+{
+    for (const auto &build : allBuilds) {
+        if (build.name == name && build.supported()) {
+            activeBuild() = &build;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Entry points forwarding to the build in use
+int Kraken_Compress(uint8_t* src, size_t src_len, uint8_t* dst, int level)
+{
+    return activeBuild().load()->compress(src, src_len, dst, level);
+}
+
+int Kraken_Decompress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len)
+{
+    return activeBuild().load()->decompress(src, src_len, dst, dst_len);
+}
+
+KrakenDecoder *Kraken_Create()
+{
+    return activeBuild().load()->create();
+}
+
+void Kraken_Destroy(KrakenDecoder *kraken)
+{
+    activeBuild().load()->destroy(kraken);
+}
+
+bool Kraken_DecodeStep(KrakenDecoder *dec, uint8_t *dst_start, int offset, size_t dst_bytes_left_in, const uint8_t *src, size_t src_bytes_left)
+{
+    return activeBuild().load()->decodeStep(dec, dst_start, offset, dst_bytes_left_in, src, src_bytes_left);
+}
+#else
+// Single ooz build, either the prebuilt library or one built from OOZ_SOURCE_DIR
+#ifdef OOZ_FROM_SOURCE
+static const std::string buildName = "source";
+#else
+static const std::string buildName = "prebuilt";
+#endif
+
+// Get the names of the builds this CPU can run
+std::vector<std::string> oozBuilds()
+{
+    return {buildName};
+}
+
+// Get the name of the build in use
+const std::string &currentOozBuild()
+{
+    return buildName;
+}
+
+// Use the given build from now on, returns false if it isn't linked in
+bool selectOozBuild(const std::string &name)
+{
+    return name == buildName;
+}
+#endif
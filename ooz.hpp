@@ -3,12 +3,45 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <string>
+#include <vector>
 
 #define SAFE_SPACE 64
 
+// Kraken streams restart their block header every 256 KB of output
+#define KRAKEN_BLOCK_SIZE 0x40000
+
 extern "C" {
     int Kraken_Compress(uint8_t* src, size_t src_len, uint8_t* dst, int level);
     int Kraken_Decompress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len);
 };
 
+// Block header of the stream being decoded
+struct KrakenHeader {
+    int decoder_type;
+    bool restart_decoder;
+    bool uncompressed;
+    bool use_checksums;
+};
+
+// Decoder state, src_used and dst_used are set by each Kraken_DecodeStep call
+struct KrakenDecoder {
+    int src_used;
+    int dst_used;
+    uint8_t *scratch;
+    size_t scratch_size;
+    KrakenHeader hdr;
+};
+
+// Step-by-step decoding, dst_start is the oldest output later blocks are allowed to reference
+KrakenDecoder *Kraken_Create();
+void Kraken_Destroy(KrakenDecoder *kraken);
+bool Kraken_DecodeStep(KrakenDecoder *dec, uint8_t *dst_start, int offset, size_t dst_bytes_left_in, const uint8_t *src, size_t src_bytes_left);
+
+// Names of the ooz builds linked in that can run on this CPU, the first one is used by default
+// With OOZ_CPU_DISPATCH there's one per instruction set level, plus the prebuilt library
+std::vector<std::string> oozBuilds();
+const std::string &currentOozBuild();
+bool selectOozBuild(const std::string &name);
+
 #endif
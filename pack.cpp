@@ -0,0 +1,353 @@
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "pack.hpp"
+#include "ooz.hpp"
+
+// Open file for reading or writing, using the wide string functions on Windows
+static FILE *openFile(const fs::path &path, bool write)
+{
+#ifdef _WIN32
+    return _wfopen(path.c_str(), write ? L"wb" : L"rb");
+#else
+    return fopen(path.c_str(), write ? "wb" : "rb");
+#endif
+}
+
+// Seek to absolute position in a possibly large file
+static bool seekFile(FILE *file, uint64_t position)
+{
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<int64_t>(position), SEEK_SET) == 0;
+#else
+    return fseeko(file, static_cast<off_t>(position), SEEK_SET) == 0;
+#endif
+}
+
+// Append little endian integer to a byte vector
+static void appendLE(std::vector<unsigned char> &bytes, uint64_t value, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        bytes.push_back(static_cast<unsigned char>(value >> (i * 8)));
+}
+
+static void writeLE(std::vector<unsigned char> &bytes, size_t position, uint64_t value, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        bytes[position + i] = static_cast<unsigned char>(value >> (i * 8));
+}
+
+// ResourceWriter constructor
+ResourceWriter::ResourceWriter(const std::string &path, const std::vector<std::string> &names, uint32_t version)
+    : path(path), names(names), version(version)
+{
+    // Header, name table, name id table and file info table come before the data
+    headerSize = (version >= 0xD ? 36 : 32) + 72;
+    namesSize = 8 + 8 * names.size();
+
+    for (const auto &name : names)
+        namesSize += name.length() + 1;
+
+    idsSize = 16 * names.size() + 8;
+    offset = headerSize + namesSize + idsSize + 144 * names.size();
+
+    file = openFile(path, true);
+
+    if (file == nullptr)
+        throw ResourceError("Failed to open " + path + " for writing: " + strerror(errno));
+
+    setvbuf(file, nullptr, _IOFBF, 1 << 20);
+
+    if (!seekFile(file, offset)) {
+        fclose(file);
+        throw ResourceError("Failed to write " + path + ": " + strerror(errno));
+    }
+
+    entries.reserve(names.size());
+}
+
+// ResourceWriter destructor
+ResourceWriter::~ResourceWriter()
+{
+    if (file != nullptr)
+        fclose(file);
+}
+
+// Start the next file, its zSize bytes of data must be written before the next one is added
+void ResourceWriter::addEntry(uint64_t size, uint64_t zSize)
+{
+    if (entries.size() == names.size())
+        throw ResourceError("Too many files added to " + path + ".");
+
+    entries.push_back({names[entries.size()], offset, size, zSize, 0});
+    offset += zSize;
+}
+
+// Append file data
+void ResourceWriter::write(const unsigned char *data, size_t size)
+{
+    if (fwrite(data, 1, size, file) != size)
+        throw ResourceError("Failed to write " + path + ": " + strerror(errno));
+}
+
+// Write the header and tables, then close the file
+void ResourceWriter::finish()
+{
+    if (entries.size() != names.size())
+        throw ResourceError("Not every file was added to " + path + ".");
+
+    std::vector<unsigned char> header(headerSize);
+    memcpy(header.data(), "IDCL", 4);
+    writeLE(header, 4, version, 4);
+
+    size_t position = version >= 0xD ? 36 : 32;
+    writeLE(header, position, entries.size(), 4);
+    writeLE(header, position + 32, headerSize, 8);
+    writeLE(header, position + 48, headerSize + namesSize + idsSize, 8);
+    writeLE(header, position + 64, headerSize + namesSize, 8);
+
+    // Name table, offsets followed by the null terminated names
+    appendLE(header, names.size(), 8);
+    uint64_t nameOffset = 0;
+
+    for (const auto &name : names) {
+        appendLE(header, nameOffset, 8);
+        nameOffset += name.length() + 1;
+    }
+
+    for (const auto &name : names)
+        header.insert(header.end(), name.c_str(), name.c_str() + name.length() + 1);
+
+    // Name id table, each file has its own name
+    appendLE(header, 0, 8);
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        appendLE(header, i, 8);
+        appendLE(header, 0, 8);
+    }
+
+    // File info table
+    for (size_t i = 0; i < entries.size(); i++) {
+        size_t infoStart = header.size();
+        header.resize(infoStart + 144);
+        writeLE(header, infoStart + 32, 2 * i, 8);
+        writeLE(header, infoStart + 56, entries[i].offset, 8);
+        writeLE(header, infoStart + 64, entries[i].zSize, 8);
+        writeLE(header, infoStart + 72, entries[i].size, 8);
+        writeLE(header, infoStart + 112, entries[i].compressionMode, 8);
+    }
+
+    bool success = fflush(file) == 0 && seekFile(file, 0) && fwrite(header.data(), 1, header.size(), file) == header.size();
+    success = fclose(file) == 0 && success;
+    file = nullptr;
+
+    if (!success)
+        throw ResourceError("Failed to write " + path + ": " + strerror(errno));
+}
+
+// Read the next part of a file being packed
+static void readChunk(FILE *file, const fs::path &path, unsigned char *data, size_t size)
+{
+    if (fread(data, 1, size, file) != size)
+        throw ResourceError("Failed to read " + path.string() + ": " + (ferror(file) ? strerror(errno) : "file was truncated"));
+}
+
+// Compress file as a single Kraken stream, returns the compressed size or 0 if it should be stored instead
+// The whole stream is decoded again and compared, as ooz can produce streams that don't decode back to some inputs
+static uint64_t compressFile(const fs::path &path, uint64_t size, int level, std::vector<unsigned char> &data, std::vector<unsigned char> &compressed, std::vector<unsigned char> &decoded)
+{
+    if (size > MAX_PACK_STREAM_SIZE)
+        return 0;
+
+    FILE *file = openFile(path, false);
+
+    if (file == nullptr)
+        throw ResourceError("Failed to open " + path.string() + ": " + strerror(errno));
+
+    try {
+        data.resize(static_cast<size_t>(size));
+        readChunk(file, path, data.data(), data.size());
+    }
+    catch (...) {
+        fclose(file);
+        throw;
+    }
+
+    fclose(file);
+
+    compressed.resize(data.size() + 65536);
+    int zSize = Kraken_Compress(data.data(), data.size(), compressed.data(), level);
+
+    // Store the file if it can't end up smaller than it is
+    if (zSize <= 0 || static_cast<uint64_t>(zSize) >= size)
+        return 0;
+
+    decoded.resize(data.size() + SAFE_SPACE);
+
+    if (Kraken_Decompress(compressed.data(), zSize, decoded.data(), data.size()) != static_cast<int>(data.size())
+    || memcmp(decoded.data(), data.data(), data.size()) != 0)
+        return 0;
+
+    compressed.resize(zSize);
+    return zSize;
+}
+
+// Copy file that's stored without compression into the archive
+static void copyFile(const fs::path &path, uint64_t size, std::vector<unsigned char> &chunk, ResourceWriter &writer)
+{
+    FILE *file = openFile(path, false);
+
+    if (file == nullptr)
+        throw ResourceError("Failed to open " + path.string() + ": " + strerror(errno));
+
+    try {
+        for (uint64_t chunkOffset = 0; chunkOffset < size; chunkOffset += PACK_CHUNK_SIZE) {
+            size_t chunkSize = static_cast<size_t>(std::min<uint64_t>(PACK_CHUNK_SIZE, size - chunkOffset));
+            chunk.resize(chunkSize);
+            readChunk(file, path, chunk.data(), chunkSize);
+            writer.write(chunk.data(), chunkSize);
+        }
+    }
+    catch (...) {
+        fclose(file);
+        throw;
+    }
+
+    fclose(file);
+}
+
+// Pack every file under the directory into a .resources archive
+PackResult packDirectory(const std::string &directoryPath, const std::string &archivePath, const PackOptions &options)
+{
+    if (options.level < 1 || options.level > MAX_PACK_LEVEL)
+        throw ResourceError("Invalid compression level: " + std::to_string(options.level));
+
+    // Collect files in a stable order, named by their path relative to the directory
+    std::vector<fs::path> paths;
+    std::vector<ResourceEntry> entries;
+    std::error_code ec;
+    fs::path archiveFile = fs::weakly_canonical(archivePath, ec);
+
+    for (fs::recursive_directory_iterator it(directoryPath, ec), end; it != end && !ec; it.increment(ec)) {
+        if (!it->is_regular_file())
+            continue;
+
+        // Leave out the archive being written, if it's inside the directory
+        if (it->path().filename() == archiveFile.filename() && fs::weakly_canonical(it->path(), ec) == archiveFile)
+            continue;
+
+        paths.push_back(it->path());
+    }
+
+    if (ec.value() != 0)
+        throw ResourceError("Failed to read " + directoryPath + ": " + ec.message());
+
+    std::sort(paths.begin(), paths.end());
+
+    std::vector<std::string> names;
+    PackResult result = {paths.size(), 0, 0};
+    entries.reserve(paths.size());
+
+    for (const auto &path : paths) {
+        uint64_t size = fs::file_size(path, ec);
+
+        if (ec.value() != 0)
+            throw ResourceError("Failed to read " + path.string() + ": " + ec.message());
+
+        names.push_back(path.lexically_relative(directoryPath).generic_u8string());
+        entries.push_back({names.back(), 0, size, size, 0});
+        result.totalSize += size;
+    }
+
+    ResourceWriter writer(archivePath, names, options.version);
+
+    if (options.progress != nullptr)
+        options.progress->start(entries.size(), result.totalSize);
+
+    // Workers compress files in parallel, the writer receives them in name order
+    std::atomic<size_t> nextEntry(0);
+    std::atomic<bool> failed(false);
+    std::exception_ptr error;
+    std::mutex writeMutex;
+    std::condition_variable writeTurn;
+    size_t nextToWrite = 0;
+
+    auto packWorker = [&]() {
+        std::vector<unsigned char> chunk;
+        std::vector<unsigned char> compressed;
+        std::vector<unsigned char> decoded;
+
+        for (size_t i = nextEntry++; i < entries.size() && !failed; i = nextEntry++) {
+            auto &entry = entries[i];
+
+            try {
+                uint64_t zSize = entry.size == 0 ? 0 : compressFile(paths[i], entry.size, options.level, chunk, compressed, decoded);
+
+                std::unique_lock<std::mutex> lock(writeMutex);
+                writeTurn.wait(lock, [&]() { return nextToWrite == i || failed; });
+
+                if (failed)
+                    break;
+
+                if (zSize != 0) {
+                    entry.zSize = zSize;
+                    writer.addEntry(entry.size, zSize);
+                    writer.write(compressed.data(), zSize);
+                }
+                else {
+                    writer.addEntry(entry.size, entry.size);
+                    copyFile(paths[i], entry.size, chunk, writer);
+                }
+
+                result.totalZSize += entry.zSize;
+                nextToWrite++;
+                writeTurn.notify_all();
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(writeMutex);
+
+                if (!error)
+                    error = std::current_exception();
+
+                failed = true;
+                writeTurn.notify_all();
+                break;
+            }
+
+            if (options.progress != nullptr)
+                options.progress->fileExtracted(entry);
+
+            // Don't keep a large file's buffers around for the next ones
+            if (chunk.capacity() > PACK_CHUNK_SIZE) {
+                std::vector<unsigned char>().swap(chunk);
+                std::vector<unsigned char>().swap(compressed);
+                std::vector<unsigned char>().swap(decoded);
+            }
+        }
+    };
+
+    if (options.threadCount <= 1) {
+        packWorker();
+    }
+    else {
+        std::vector<std::thread> threads;
+
+        for (unsigned int i = 0; i < options.threadCount; i++)
+            threads.emplace_back(packWorker);
+
+        for (auto &thread : threads)
+            thread.join();
+    }
+
+    if (options.progress != nullptr)
+        options.progress->finish();
+
+    if (error)
+        std::rethrow_exception(error);
+
+    writer.finish();
+    return result;
+}
@@ -0,0 +1,63 @@
+#ifndef PACK_HPP
+#define PACK_HPP
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "archive.hpp"
+#include "progress.hpp"
+
+// Files are read and copied in chunks of this size
+#define PACK_CHUNK_SIZE (64ULL << 20)
+
+// Kraken_Compress and Kraken_Decompress return the size as an int, so larger files are stored uncompressed
+#define MAX_PACK_STREAM_SIZE MAX_STREAM_WINDOW_SIZE
+
+// Kraken levels above 7 crash on some inputs
+#define MAX_PACK_LEVEL 7
+
+// Settings for packDirectory
+struct PackOptions {
+    uint32_t version = 0xD;
+    int level = 4;
+    unsigned int threadCount = 1;
+    ProgressReporter *progress = nullptr;
+};
+
+// Totals of a packed archive
+struct PackResult {
+    size_t entryCount;
+    uint64_t totalSize;
+    uint64_t totalZSize;
+};
+
+// Writes a .resources archive with the given file names
+//
+// Space for the header and tables is reserved up front, so file data can be streamed to disk
+// in name order as it's added, and the tables are written over it once every entry is known.
+class ResourceWriter {
+public:
+    ResourceWriter(const std::string &path, const std::vector<std::string> &names, uint32_t version);
+    ~ResourceWriter();
+
+    ResourceWriter(const ResourceWriter&) = delete;
+    ResourceWriter &operator=(const ResourceWriter&) = delete;
+
+    void addEntry(uint64_t size, uint64_t zSize);
+    void write(const unsigned char *data, size_t size);
+    void finish();
+private:
+    std::string path;
+    std::vector<std::string> names;
+    uint32_t version;
+    FILE *file;
+    std::vector<ResourceEntry> entries;
+    uint64_t headerSize;
+    uint64_t namesSize;
+    uint64_t idsSize;
+    uint64_t offset;
+};
+
+PackResult packDirectory(const std::string &directoryPath, const std::string &archivePath, const PackOptions &options);
+
+#endif
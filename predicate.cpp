@@ -0,0 +1,259 @@
+#include <algorithm>
+#include <cctype>
+#include "predicate.hpp"
+#include "utils.hpp"
+
+using Operation = PredicateInstruction::Operation;
+using Field = PredicateInstruction::Field;
+using Comparison = PredicateInstruction::Comparison;
+
+// Recursive descent compiler from a predicate expression to postfix instructions
+class PredicateCompiler {
+public:
+    PredicateCompiler(const std::string &expression, std::vector<PredicateInstruction> &program) : expression(expression), program(program) {}
+
+    void compile()
+    {
+        nextToken();
+        parseOr(0);
+
+        if (!token.empty())
+            fail("unexpected '" + token + "'");
+    }
+private:
+    const std::string &expression;
+    std::vector<PredicateInstruction> &program;
+    std::string token;
+    size_t position = 0;
+
+    [[noreturn]] void fail(const std::string &error)
+    {
+        throw ResourceError("Invalid condition \"" + expression + "\": " + error + ".");
+    }
+
+    // Read the next word, number, operator or parenthesis, leaving an empty token at the end
+    void nextToken()
+    {
+        while (position < expression.length() && isspace(static_cast<unsigned char>(expression[position])))
+            position++;
+
+        token.clear();
+
+        if (position == expression.length())
+            return;
+
+        char c = expression[position];
+
+        if (isalnum(static_cast<unsigned char>(c)) || c == '.' || c == '_') {
+            while (position < expression.length() && (isalnum(static_cast<unsigned char>(expression[position])) || expression[position] == '.' || expression[position] == '_'))
+                token.push_back(expression[position++]);
+        }
+        else if (c == '<' || c == '>' || c == '=' || c == '!') {
+            token.push_back(expression[position++]);
+
+            if (position < expression.length() && expression[position] == '=')
+                token.push_back(expression[position++]);
+        }
+        else {
+            token.push_back(expression[position++]);
+        }
+    }
+
+    void emit(Operation operation)
+    {
+        program.push_back({operation, Field::Size, Comparison::Equal, 0, 0});
+    }
+
+    void parseOr(size_t depth)
+    {
+        parseAnd(depth);
+
+        while (token == "or") {
+            nextToken();
+            parseAnd(depth + 1);
+            emit(Operation::Or);
+        }
+    }
+
+    void parseAnd(size_t depth)
+    {
+        parseNot(depth);
+
+        while (token == "and") {
+            nextToken();
+            parseNot(depth + 1);
+            emit(Operation::And);
+        }
+    }
+
+    void parseNot(size_t depth)
+    {
+        if (depth >= MAX_PREDICATE_DEPTH)
+            fail("too deeply nested");
+
+        if (token == "not") {
+            nextToken();
+            parseNot(depth + 1);
+            emit(Operation::Not);
+            return;
+        }
+
+        parseCondition(depth);
+    }
+
+    void parseCondition(size_t depth)
+    {
+        if (token.empty())
+            fail("expected a condition at the end");
+
+        if (token == "(") {
+            nextToken();
+            parseOr(depth + 1);
+
+            if (token != ")")
+                fail("expected ')'");
+
+            nextToken();
+            return;
+        }
+
+        if (token == "compressed" || token == "stored") {
+            emit(token == "compressed" ? Operation::Compressed : Operation::Stored);
+            nextToken();
+            return;
+        }
+
+        PredicateInstruction instruction = {Operation::Compare, Field::Size, Comparison::Equal, 0, 0};
+
+        if (token == "size")
+            instruction.field = Field::Size;
+        else if (token == "zsize")
+            instruction.field = Field::ZSize;
+        else if (token == "ratio")
+            instruction.field = Field::Ratio;
+        else if (token == "offset")
+            instruction.field = Field::Offset;
+        else
+            fail("unknown condition '" + token + "'");
+
+        nextToken();
+
+        if (token == "<")
+            instruction.comparison = Comparison::Less;
+        else if (token == "<=")
+            instruction.comparison = Comparison::LessEqual;
+        else if (token == ">")
+            instruction.comparison = Comparison::Greater;
+        else if (token == ">=")
+            instruction.comparison = Comparison::GreaterEqual;
+        else if (token == "=" || token == "==")
+            instruction.comparison = Comparison::Equal;
+        else if (token == "!=")
+            instruction.comparison = Comparison::NotEqual;
+        else
+            fail("expected a comparison instead of '" + token + "'");
+
+        nextToken();
+
+        if (instruction.field == Field::Ratio) {
+            size_t end = 0;
+
+            try {
+                instruction.ratio = std::stod(token, &end);
+            }
+            catch (const std::exception &e) {
+            }
+
+            if (token.empty() || end != token.length())
+                fail("invalid ratio '" + token + "'");
+        }
+        else if (!parseSize(token, instruction.value)) {
+            fail("invalid size '" + token + "'");
+        }
+
+        program.push_back(instruction);
+        nextToken();
+    }
+};
+
+// EntryPredicate constructor, compiles the expression
+EntryPredicate::EntryPredicate(const std::string &expression)
+{
+    PredicateCompiler(expression, program).compile();
+}
+
+template <typename T>
+static inline bool compare(Comparison comparison, T a, T b)
+{
+    switch (comparison) {
+        case Comparison::Less:
+            return a < b;
+        case Comparison::LessEqual:
+            return a <= b;
+        case Comparison::Greater:
+            return a > b;
+        case Comparison::GreaterEqual:
+            return a >= b;
+        case Comparison::Equal:
+            return a == b;
+        default:
+            return a != b;
+    }
+}
+
+// Whether any comparison of the predicate is on the given field
+bool EntryPredicate::usesField(Field field) const
+{
+    return std::any_of(program.begin(), program.end(), [&](const PredicateInstruction &instruction) {
+        return instruction.operation == Operation::Compare && instruction.field == field;
+    });
+}
+
+// Check the entry's index metadata against the predicate, an empty one matches every entry
+bool EntryPredicate::matches(const ResourceEntry &entry) const
+{
+    bool stack[MAX_PREDICATE_DEPTH + 1];
+    size_t top = 0;
+    bool compressed = entry.size != 0 && entry.size != entry.zSize;
+
+    for (const auto &instruction : program) {
+        switch (instruction.operation) {
+            case Operation::Compare:
+                switch (instruction.field) {
+                    case Field::Size:
+                        stack[top++] = compare(instruction.comparison, entry.size, instruction.value);
+                        break;
+                    case Field::ZSize:
+                        stack[top++] = compare(instruction.comparison, entry.zSize, instruction.value);
+                        break;
+                    case Field::Ratio:
+                        stack[top++] = compare(instruction.comparison, entry.size == 0 ? 1.0 : static_cast<double>(entry.zSize) / entry.size, instruction.ratio);
+                        break;
+                    case Field::Offset:
+                        stack[top++] = compare(instruction.comparison, entry.offset, instruction.value);
+                        break;
+                }
+
+                break;
+            case Operation::Compressed:
+                stack[top++] = compressed;
+                break;
+            case Operation::Stored:
+                stack[top++] = !compressed;
+                break;
+            case Operation::And:
+                top--;
+                stack[top - 1] = stack[top - 1] && stack[top];
+                break;
+            case Operation::Or:
+                top--;
+                stack[top - 1] = stack[top - 1] || stack[top];
+                break;
+            case Operation::Not:
+                stack[top - 1] = !stack[top - 1];
+                break;
+        }
+    }
+
+    return top == 0 || stack[0];
+}
@@ -0,0 +1,63 @@
+#ifndef PREDICATE_HPP
+#define PREDICATE_HPP
+
+#include <string>
+#include <vector>
+#include "archive.hpp"
+
+// Deepest nesting of conditions a predicate can have
+#define MAX_PREDICATE_DEPTH 64
+
+// Step of a compiled predicate, run on a stack of booleans
+struct PredicateInstruction {
+    enum class Operation {
+        Compare,
+        Compressed,
+        Stored,
+        And,
+        Or,
+        Not
+    };
+
+    enum class Field {
+        Size,
+        ZSize,
+        Ratio,
+        Offset
+    };
+
+    enum class Comparison {
+        Less,
+        LessEqual,
+        Greater,
+        GreaterEqual,
+        Equal,
+        NotEqual
+    };
+
+    Operation operation;
+    Field field;
+    Comparison comparison;
+    uint64_t value;
+    double ratio;
+};
+
+// Condition on the index metadata of an entry, so it can be checked without touching the entry's data
+//
+// Conditions compare the fields size, zsize, ratio (zsize / size) and offset with <, <=, >, >=, = or !=, sizes taking
+// K, M and G suffixes, or test the compressed and stored flags. They're combined with and, or, not and parentheses,
+// e.g. "size<1M and compressed" or "not (offset>=2G and offset<3G)". The expression is compiled once into a
+// postfix program, so checking an entry is a single pass over it.
+class EntryPredicate {
+public:
+    EntryPredicate() = default;
+    explicit EntryPredicate(const std::string &expression);
+
+    bool empty() const { return program.empty(); }
+    bool usesField(PredicateInstruction::Field field) const;
+    bool matches(const ResourceEntry &entry) const;
+private:
+    std::vector<PredicateInstruction> program;
+};
+
+#endif
@@ -0,0 +1,161 @@
+#include <cstdio>
+#include <cstdint>
+#include "progress.hpp"
+
+// ProgressQueue constructor, capacity must be a power of two
+ProgressQueue::ProgressQueue(size_t capacity) : slots(new Slot[capacity]), mask(capacity - 1), enqueuePosition(0), dequeuePosition(0)
+{
+    for (size_t i = 0; i < capacity; i++)
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+// Push entry, returns false instead of waiting if the queue is full
+bool ProgressQueue::tryPush(const ResourceEntry *entry)
+{
+    size_t position = enqueuePosition.load(std::memory_order_relaxed);
+    Slot *slot;
+
+    while (true) {
+        slot = &slots[position & mask];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        auto difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+        if (difference == 0) {
+            if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (difference < 0) {
+            return false;
+        }
+        else {
+            position = enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->entry = entry;
+    slot->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+// Pop entry, returns false if the queue is empty
+bool ProgressQueue::tryPop(const ResourceEntry *&entry)
+{
+    Slot &slot = slots[dequeuePosition & mask];
+    size_t sequence = slot.sequence.load(std::memory_order_acquire);
+
+    if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(dequeuePosition + 1) < 0)
+        return false;
+
+    entry = slot.entry;
+    slot.sequence.store(dequeuePosition + mask + 1, std::memory_order_release);
+    dequeuePosition++;
+    return true;
+}
+
+// ProgressReporter constructor
+ProgressReporter::ProgressReporter(ProgressMode mode, std::ostream &out, bool terminal, const std::string &action)
+    : mode(mode), out(out), terminal(terminal), action(action), queue(PROGRESS_QUEUE_SIZE), filesDone(0), bytesDone(0), droppedLines(0), begin(std::chrono::steady_clock::now())
+{
+}
+
+// ProgressReporter destructor
+ProgressReporter::~ProgressReporter()
+{
+    finish();
+}
+
+// Set the totals and start rendering
+void ProgressReporter::start(size_t totalFiles, uint64_t totalBytes)
+{
+    this->totalFiles = totalFiles;
+    this->totalBytes = totalBytes;
+    begin = std::chrono::steady_clock::now();
+    renderThread = std::thread(&ProgressReporter::render, this);
+}
+
+// Report extracted file, never blocks
+void ProgressReporter::fileExtracted(const ResourceEntry &entry)
+{
+    filesDone.fetch_add(1, std::memory_order_relaxed);
+    bytesDone.fetch_add(entry.size, std::memory_order_relaxed);
+
+    if (mode == ProgressMode::Log && !queue.tryPush(&entry))
+        droppedLines.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Stop rendering after flushing pending events
+void ProgressReporter::finish()
+{
+    if (!renderThread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(renderMutex);
+        stopping = true;
+    }
+
+    renderWake.notify_one();
+    renderThread.join();
+}
+
+// Format the progress line: files, bytes, throughput and ETA
+std::string ProgressReporter::progressLine() const
+{
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    size_t files = filesDone.load(std::memory_order_relaxed);
+    uint64_t bytes = bytesDone.load(std::memory_order_relaxed);
+    double megabytesPerSecond = elapsed > 0 ? bytes / elapsed / (1024 * 1024) : 0;
+    double percent = totalBytes > 0 ? 100.0 * bytes / totalBytes : (totalFiles > 0 ? 100.0 * files / totalFiles : 100);
+
+    char line[160];
+    int length = snprintf(line, sizeof(line), "[%5.1f%%] %zu/%zu files, %.1f/%.1f MB, %.1f MB/s",
+        percent, files, totalFiles, bytes / (1024.0 * 1024), totalBytes / (1024.0 * 1024), megabytesPerSecond);
+
+    if (bytes > 0 && bytes < totalBytes)
+        snprintf(line + length, sizeof(line) - length, ", ETA %.0fs", (totalBytes - bytes) / (bytes / elapsed));
+
+    return line;
+}
+
+// Render loop, redraws the progress line or writes queued log lines in batches
+void ProgressReporter::render()
+{
+    // Progress lines written to logs are printed less often, as they can't be overwritten
+    const auto interval = std::chrono::milliseconds(mode == ProgressMode::Log ? 50 : (terminal ? 100 : 2000));
+    std::string output;
+    bool done = false;
+
+    while (!done) {
+        {
+            std::unique_lock<std::mutex> lock(renderMutex);
+            renderWake.wait_for(lock, interval, [this]() { return stopping; });
+            done = stopping;
+        }
+
+        output.clear();
+
+        if (mode == ProgressMode::Log) {
+            const ResourceEntry *entry;
+
+            while (queue.tryPop(entry))
+                output += action + ' ' + entry->name + "...\n";
+
+            if (done && droppedLines > 0)
+                output += "(" + std::to_string(droppedLines.load()) + " log lines were dropped to keep up with extraction)\n";
+        }
+        else if (terminal) {
+            output = "\r" + progressLine() + "\x1b[K";
+
+            if (done)
+                output += '\n';
+        }
+        else {
+            output = progressLine() + '\n';
+        }
+
+        if (!output.empty()) {
+            out.write(output.data(), static_cast<std::streamsize>(output.length()));
+            out.flush();
+        }
+    }
+}
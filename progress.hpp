@@ -0,0 +1,76 @@
+#ifndef PROGRESS_HPP
+#define PROGRESS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include "archive.hpp"
+
+#define PROGRESS_QUEUE_SIZE 65536
+
+// How extraction progress is displayed
+enum class ProgressMode {
+    Log,
+    Bar
+};
+
+// Bounded lock-free queue of extracted entries, many producers and a single consumer
+class ProgressQueue {
+public:
+    explicit ProgressQueue(size_t capacity);
+
+    bool tryPush(const ResourceEntry *entry);
+    bool tryPop(const ResourceEntry *&entry);
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        const ResourceEntry *entry;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+    alignas(64) std::atomic<size_t> enqueuePosition;
+    alignas(64) size_t dequeuePosition;
+};
+
+// Renders extraction (or packing) progress on its own thread, so extraction never waits on terminal output
+//
+// Workers only push events into a ProgressQueue and bump atomic counters. If the queue is full,
+// log lines are dropped and counted instead of blocking, while the totals stay exact.
+class ProgressReporter {
+public:
+    ProgressReporter(ProgressMode mode, std::ostream &out, bool terminal, const std::string &action = "Extracting");
+    ~ProgressReporter();
+
+    ProgressReporter(const ProgressReporter&) = delete;
+    ProgressReporter &operator=(const ProgressReporter&) = delete;
+
+    void start(size_t totalFiles, uint64_t totalBytes);
+    void fileExtracted(const ResourceEntry &entry);
+    void finish();
+private:
+    ProgressMode mode;
+    std::ostream &out;
+    bool terminal;
+    std::string action;
+    ProgressQueue queue;
+    std::atomic<size_t> filesDone;
+    std::atomic<uint64_t> bytesDone;
+    std::atomic<size_t> droppedLines;
+    size_t totalFiles = 0;
+    uint64_t totalBytes = 0;
+    std::chrono::steady_clock::time_point begin;
+    std::mutex renderMutex;
+    std::condition_variable renderWake;
+    bool stopping = false;
+    std::thread renderThread;
+
+    void render();
+    std::string progressLine() const;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#include <algorithm>
+#include "raw.hpp"
+
+static void appendLE(std::vector<unsigned char> &bytes, uint64_t value, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        bytes.push_back(static_cast<unsigned char>(value >> (i * 8)));
+}
+
+// Copy an entry's stored bytes verbatim into the sink as NAME.eraw, after a header describing how to decompress them
+// Compressed data keeps its oodle header, which is skipped on decompression as flagged by the compression mode
+void writeRawEntry(const ResourceArchive &archive, const ResourceEntry &entry, OutputSink &sink)
+{
+    std::vector<unsigned char> header = {'E', 'R', 'A', 'W'};
+    appendLE(header, RAW_VERSION, 4);
+    appendLE(header, entry.size, 8);
+    appendLE(header, entry.zSize, 8);
+    appendLE(header, entry.compressionMode, 8);
+    appendLE(header, entry.name.length(), 4);
+    header.insert(header.end(), entry.name.begin(), entry.name.end());
+
+    uint64_t rawSize = header.size() + entry.zSize;
+    ResourceEntry rawEntry = {entry.name + RAW_EXTENSION, entry.offset, rawSize, rawSize, 0};
+
+    auto writer = sink.openFile(rawEntry);
+    writer->write(header.data(), header.size());
+    writer->write(archive.memoryMappedFile->memp + entry.offset, entry.zSize);
+    writer->close();
+}
+
+// Find every raw file under the given directory, in path order
+// They're opened together as a ResourceArchive to be extracted like the entries of an archive
+std::vector<fs::path> findRawFiles(const std::string &rawPath)
+{
+    std::vector<fs::path> rawFiles;
+    std::error_code ec;
+
+    for (fs::recursive_directory_iterator it(rawPath, ec), end; it != end && !ec; it.increment(ec)) {
+        if (it->is_regular_file() && it->path().extension() == RAW_EXTENSION)
+            rawFiles.push_back(it->path());
+    }
+
+    if (ec.value() != 0)
+        throw ResourceError("Failed to read " + rawPath + ": " + ec.message());
+
+    std::sort(rawFiles.begin(), rawFiles.end());
+    return rawFiles;
+}
@@ -0,0 +1,15 @@
+#ifndef RAW_HPP
+#define RAW_HPP
+
+#include <string>
+#include <vector>
+#include "archive.hpp"
+#include "sink.hpp"
+
+// Extension of the files written by --raw, each one a single entry archive ResourceArchive can open
+#define RAW_EXTENSION ".eraw"
+
+void writeRawEntry(const ResourceArchive &archive, const ResourceEntry &entry, OutputSink &sink);
+std::vector<fs::path> findRawFiles(const std::string &rawPath);
+
+#endif
@@ -0,0 +1,326 @@
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include "server.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+#define MAX_REQUEST_LENGTH 65536
+
+#ifdef _WIN32
+// Unix domain sockets are not supported on Windows builds
+ResourceServer::ResourceServer(ResourceFilesystem &filesystem, const std::string &socketPath) : filesystem(filesystem), socketPath(socketPath), listenSocket(-1), wakePipe{-1, -1}, stopping(false)
+{
+    throw ResourceError("Serving over a Unix domain socket is not supported on Windows.");
+}
+
+ResourceServer::~ResourceServer() = default;
+void ResourceServer::run(unsigned int) {}
+void ResourceServer::stop() {}
+#else
+// ResourceServer constructor, binds and listens on the socket
+ResourceServer::ResourceServer(ResourceFilesystem &filesystem, const std::string &socketPath) : filesystem(filesystem), socketPath(socketPath), wakePipe{-1, -1}, stopping(false)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+
+    if (socketPath.length() >= sizeof(address.sun_path))
+        throw ResourceError("Socket path " + socketPath + " is too long.");
+
+    memcpy(address.sun_path, socketPath.c_str(), socketPath.length() + 1);
+
+    // Remove stale socket from a previous run
+    struct stat st;
+
+    if (::stat(socketPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(socketPath.c_str());
+
+    listenSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (listenSocket == -1)
+        throw ResourceError(std::string("Failed to create socket: ") + strerror(errno));
+
+    if (bind(listenSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1 || listen(listenSocket, SOMAXCONN) == -1) {
+        int error = errno;
+        close(listenSocket);
+        throw ResourceError("Failed to listen on " + socketPath + ": " + strerror(error));
+    }
+
+    // Wakes the polling thread when a connection is handed back or the server is stopped
+    if (pipe2(wakePipe, O_CLOEXEC | O_NONBLOCK) == -1) {
+        int error = errno;
+        close(listenSocket);
+        unlink(socketPath.c_str());
+        throw ResourceError(std::string("Failed to create pipe: ") + strerror(error));
+    }
+}
+
+// ResourceServer destructor
+ResourceServer::~ResourceServer()
+{
+    close(listenSocket);
+    close(wakePipe[0]);
+    close(wakePipe[1]);
+    unlink(socketPath.c_str());
+}
+
+// Wake the polling thread, the pipe is only full if it already has a wakeup pending
+static void wakePoller(int pipeEnd)
+{
+    while (write(pipeEnd, "", 1) == -1 && errno == EINTR) {}
+}
+
+// Accept clients and answer their requests on the given number of threads until stopped
+void ResourceServer::run(unsigned int threadCount)
+{
+    std::vector<std::thread> threads;
+
+    for (unsigned int i = 0; i < std::max(threadCount, 1U); i++)
+        threads.emplace_back(&ResourceServer::requestWorker, this);
+
+    pollClients();
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+
+    queueChanged.notify_all();
+
+    for (auto &thread : threads)
+        thread.join();
+
+    for (const auto &client : requestQueue)
+        close(client.socket);
+
+    for (const auto &client : returnedClients)
+        close(client.socket);
+
+    requestQueue.clear();
+    returnedClients.clear();
+}
+
+// Stop accepting clients, making run() return once the requests being answered are done
+void ResourceServer::stop()
+{
+    stopping = true;
+    wakePoller(wakePipe[1]);
+}
+
+// Wait for new connections and requests on idle ones, queueing each connection with a request for the workers
+void ResourceServer::pollClients()
+{
+    std::vector<Client> idleClients;
+    std::vector<pollfd> pollSockets;
+
+    while (!stopping) {
+        pollSockets.assign({{wakePipe[0], POLLIN, 0}, {listenSocket, POLLIN, 0}});
+
+        for (const auto &client : idleClients)
+            pollSockets.push_back({client.socket, POLLIN, 0});
+
+        if (poll(pollSockets.data(), pollSockets.size(), -1) == -1) {
+            if (errno == EINTR)
+                continue;
+
+            break;
+        }
+
+        // Take back the connections the workers are done with
+        if (pollSockets[0].revents != 0) {
+            char drain[64];
+
+            while (read(wakePipe[0], drain, sizeof(drain)) > 0) {}
+
+            std::lock_guard<std::mutex> lock(queueMutex);
+
+            for (auto &client : returnedClients)
+                idleClients.push_back(std::move(client));
+
+            returnedClients.clear();
+        }
+
+        if ((pollSockets[1].revents & POLLIN) != 0) {
+            int clientSocket = accept4(listenSocket, nullptr, nullptr, SOCK_CLOEXEC);
+
+            if (clientSocket != -1)
+                idleClients.push_back({clientSocket, ""});
+            else if (errno != EINTR && errno != ECONNABORTED && errno != EAGAIN)
+                break;
+        }
+
+        // Sockets polled this round are the first ones in idleClients, new ones were added after them
+        std::vector<Client> stillIdle;
+        bool queued = false;
+
+        for (size_t i = 0; i < idleClients.size(); i++) {
+            if (i + 2 < pollSockets.size() && pollSockets[i + 2].fd == idleClients[i].socket && pollSockets[i + 2].revents != 0) {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                requestQueue.push_back(std::move(idleClients[i]));
+                queued = true;
+            }
+            else {
+                stillIdle.push_back(std::move(idleClients[i]));
+            }
+        }
+
+        idleClients.swap(stillIdle);
+
+        if (queued)
+            queueChanged.notify_all();
+    }
+
+    for (const auto &client : idleClients)
+        close(client.socket);
+}
+
+// Answer one request at a time from the queued connections, then requeue them or hand them back to be polled
+void ResourceServer::requestWorker()
+{
+    while (true) {
+        Client client;
+
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueChanged.wait(lock, [&]() { return stopping || !requestQueue.empty(); });
+
+            if (stopping)
+                return;
+
+            client = std::move(requestQueue.front());
+            requestQueue.pop_front();
+        }
+
+        if (!serveNextRequest(client)) {
+            close(client.socket);
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(queueMutex);
+
+        // Pipelined requests already received go to the back of the queue, behind other clients' requests
+        if (client.pending.find('\n') != std::string::npos) {
+            requestQueue.push_back(std::move(client));
+            queueChanged.notify_one();
+        }
+        else {
+            returnedClients.push_back(std::move(client));
+            wakePoller(wakePipe[1]);
+        }
+    }
+}
+
+// Send all bytes to the client
+static bool sendAll(int clientSocket, const void *data, size_t size)
+{
+    const auto *bytes = static_cast<const char*>(data);
+
+    while (size > 0) {
+        ssize_t sent = send(clientSocket, bytes, size, MSG_NOSIGNAL);
+
+        if (sent == -1) {
+            if (errno == EINTR)
+                continue;
+
+            return false;
+        }
+
+        bytes += sent;
+        size -= sent;
+    }
+
+    return true;
+}
+
+// Answer the client's next request, reading more of it first if it hasn't fully arrived
+// Returns false if the connection should be closed
+bool ResourceServer::serveNextRequest(Client &client)
+{
+    size_t lineEnd = client.pending.find('\n');
+
+    if (lineEnd == std::string::npos) {
+        char buffer[4096];
+        ssize_t received;
+
+        do {
+            received = recv(client.socket, buffer, sizeof(buffer), 0);
+        } while (received == -1 && errno == EINTR);
+
+        if (received <= 0)
+            return false;
+
+        client.pending.append(buffer, received);
+        lineEnd = client.pending.find('\n');
+
+        // Wait for the rest of the line
+        if (lineEnd == std::string::npos)
+            return client.pending.length() <= MAX_REQUEST_LENGTH;
+    }
+
+    std::string request = client.pending.substr(0, lineEnd);
+    client.pending.erase(0, lineEnd + 1);
+
+    if (!request.empty() && request.back() == '\r')
+        request.pop_back();
+
+    return handleRequest(client.socket, request);
+}
+
+// Answer a single request, returns false if the connection should be closed
+bool ResourceServer::handleRequest(int clientSocket, const std::string &request)
+{
+    size_t separator = request.find(' ');
+    std::string command = request.substr(0, separator);
+    std::string path = separator == std::string::npos ? "" : request.substr(separator + 1);
+    VfsStat stat;
+
+    if (command == "STAT") {
+        if (!filesystem.stat(path, stat))
+            return sendAll(clientSocket, "ERR Not found\n", 14);
+
+        std::string response = stat.isDirectory ? "OK DIR\n" : "OK " + std::to_string(stat.size) + "\n";
+        return sendAll(clientSocket, response.data(), response.length());
+    }
+
+    if (command == "GET") {
+        if (!filesystem.stat(path, stat) || stat.isDirectory)
+            return sendAll(clientSocket, "ERR Not found\n", 14);
+
+        VfsFile file;
+
+        try {
+            file = filesystem.open(path);
+        }
+        catch (const std::exception &e) {
+            std::string response = std::string("ERR ") + e.what() + "\n";
+            return sendAll(clientSocket, response.data(), response.length());
+        }
+
+        std::string response = "OK " + std::to_string(file.size) + "\n";
+        return sendAll(clientSocket, response.data(), response.length()) && sendAll(clientSocket, file.data, file.size);
+    }
+
+    if (command == "LIST") {
+        std::vector<std::pair<std::string, VfsStat>> children;
+
+        if (!filesystem.listDirectory(path, children))
+            return sendAll(clientSocket, "ERR Not a directory\n", 20);
+
+        std::string response = "OK " + std::to_string(children.size()) + "\n";
+
+        for (const auto &child : children)
+            response += (child.second.isDirectory ? "DIR" : std::to_string(child.second.size)) + " " + child.first + "\n";
+
+        return sendAll(clientSocket, response.data(), response.length());
+    }
+
+    return sendAll(clientSocket, "ERR Unknown command\n", 20);
+}
+#endif
@@ -0,0 +1,55 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "vfs.hpp"
+
+// Serves lookup/fetch requests for files in a ResourceFilesystem over a Unix domain socket
+//
+// Requests are single lines, answered in order on the same connection:
+//   STAT <path>  ->  "OK <size>\n", "OK DIR\n" or "ERR <message>\n"
+//   GET <path>   ->  "OK <size>\n" followed by the file data, or "ERR <message>\n"
+//   LIST <path>  ->  "OK <count>\n" followed by one "<size|DIR> <name>\n" line per child
+//
+// One thread polls the idle connections, and hands each request to the worker threads as it arrives,
+// so a few open connections can't keep the workers from answering the others.
+class ResourceServer {
+public:
+    ResourceServer(ResourceFilesystem &filesystem, const std::string &socketPath);
+    ~ResourceServer();
+
+    ResourceServer(const ResourceServer&) = delete;
+    ResourceServer &operator=(const ResourceServer&) = delete;
+
+    void run(unsigned int threadCount);
+    void stop();
+private:
+    // Connection with the part of the next request received so far
+    struct Client {
+        int socket;
+        std::string pending;
+    };
+
+    ResourceFilesystem &filesystem;
+    std::string socketPath;
+    int listenSocket;
+    int wakePipe[2];
+    std::atomic<bool> stopping;
+
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;
+    std::deque<Client> requestQueue;
+    std::vector<Client> returnedClients;
+
+    void pollClients();
+    void requestWorker();
+    bool serveNextRequest(Client &client);
+    bool handleRequest(int clientSocket, const std::string &request);
+};
+
+#endif
@@ -0,0 +1,592 @@
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <vector>
+#include "sink.hpp"
+#include "utils.hpp"
+#include "stats.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <winioctl.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+// Collects the pieces of a file and writes it whole on close
+class BufferedFileWriter : public FileWriter {
+public:
+    BufferedFileWriter(OutputSink &sink, const ResourceEntry &entry) : sink(sink), entry(entry)
+    {
+        data.reserve(entry.size);
+    }
+
+    void write(const unsigned char *data, size_t size) override
+    {
+        this->data.insert(this->data.end(), data, data + size);
+    }
+
+    void close() override
+    {
+        sink.writeFile(entry, data.data());
+    }
+private:
+    OutputSink &sink;
+    const ResourceEntry &entry;
+    std::vector<unsigned char> data;
+};
+
+// Check whether a block of data is all zeros
+// Words are OR-ed together in independent lanes without branching, so compilers turn the loop into vector instructions
+static bool isZeroBlock(const unsigned char *data, size_t size)
+{
+    uint64_t lanes[8] = {};
+    size_t i = 0;
+
+    for (; i + sizeof(lanes) <= size; i += sizeof(lanes)) {
+        uint64_t words[8];
+        memcpy(words, data + i, sizeof(words));
+
+        for (int j = 0; j < 8; j++)
+            lanes[j] |= words[j];
+    }
+
+    uint64_t result = 0;
+
+    for (int j = 0; j < 8; j++)
+        result |= lanes[j];
+
+    for (; i < size; i++)
+        result |= data[i];
+
+    return result == 0;
+}
+
+// Mark a file as sparse, needed on Windows for skipped ranges to become holes
+static void markSparse(FILE *file)
+{
+#ifdef _WIN32
+    DWORD returned;
+    DeviceIoControl(reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(file))), FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &returned, nullptr);
+#else
+    (void)file;
+#endif
+}
+
+// Write data at the given position at the end of a file, seeking over the blocks of zeros aligned to SPARSE_BLOCK_SIZE
+// instead of writing them. writtenSize is increased by the bytes actually written.
+static bool writeSparse(FILE *file, const unsigned char *data, size_t size, uint64_t position, uint64_t &writtenSize)
+{
+    // Bytes before the first block boundary are always written
+    size_t blockStart = static_cast<size_t>(std::min<uint64_t>(size, (SPARSE_BLOCK_SIZE - position % SPARSE_BLOCK_SIZE) % SPARSE_BLOCK_SIZE));
+    size_t runStart = 0;
+
+    for (size_t i = blockStart; i + SPARSE_BLOCK_SIZE <= size;) {
+        if (!isZeroBlock(data + i, SPARSE_BLOCK_SIZE)) {
+            i += SPARSE_BLOCK_SIZE;
+            continue;
+        }
+
+        size_t holeEnd = i + SPARSE_BLOCK_SIZE;
+
+        while (holeEnd + SPARSE_BLOCK_SIZE <= size && isZeroBlock(data + holeEnd, SPARSE_BLOCK_SIZE))
+            holeEnd += SPARSE_BLOCK_SIZE;
+
+        if (fwrite(data + runStart, 1, i - runStart, file) != i - runStart)
+            return false;
+
+#ifdef _WIN32
+        if (_fseeki64(file, static_cast<int64_t>(holeEnd - i), SEEK_CUR) != 0)
+#else
+        if (fseeko(file, static_cast<off_t>(holeEnd - i), SEEK_CUR) != 0)
+#endif
+            return false;
+
+        writtenSize += i - runStart;
+        runStart = holeEnd;
+        i = holeEnd;
+    }
+
+    if (fwrite(data + runStart, 1, size - runStart, file) != size - runStart)
+        return false;
+
+    writtenSize += size - runStart;
+    return true;
+}
+
+// Set the size of a sparse file, which ends short of it if its last blocks were skipped
+static bool endSparse(FILE *file, uint64_t size)
+{
+    if (fflush(file) != 0)
+        return false;
+
+#ifdef _WIN32
+    return _chsize_s(_fileno(file), static_cast<int64_t>(size)) == 0;
+#else
+    return ftruncate(fileno(file), static_cast<off_t>(size)) == 0;
+#endif
+}
+
+// Open the entry to be written in pieces
+std::unique_ptr<FileWriter> OutputSink::openFile(const ResourceEntry &entry)
+{
+    return std::unique_ptr<FileWriter>(new BufferedFileWriter(*this, entry));
+}
+
+// DirectorySink constructor
+DirectorySink::DirectorySink(const std::string &outPath, bool atomic, bool sparse)
+    : outPath(outPath), atomic(atomic), sparse(sparse), logicalBytes(0), writtenBytes(0)
+{
+    if (!this->outPath.empty() && this->outPath.back() != fs::path::preferred_separator)
+        this->outPath.push_back(fs::path::preferred_separator);
+}
+
+// Create the directories for the entry and get the path to write it to
+fs::path DirectorySink::createFilePath(const ResourceEntry &entry)
+{
+    auto filePath = fs::path(outPath + entry.name).make_preferred();
+    PhaseTimer timer(Phase::Mkpath, entry.size);
+
+    if (mkpath(filePath, outPath.length()) != 0)
+        throw ResourceError("Failed to create " + filePath.parent_path().string() + " path for extraction: " + strerror(errno));
+
+    if (fs::is_directory(filePath))
+        filePath += " (1)";
+
+    return filePath;
+}
+
+// Write file into the out directory, keeping its path inside the archive
+void DirectorySink::writeFile(const ResourceEntry &entry, const unsigned char *data)
+{
+    if (atomic || sparse) {
+        auto writer = openFile(entry);
+        writer->write(data, entry.size);
+        writer->close();
+        return;
+    }
+
+    auto filePath = createFilePath(entry);
+    PhaseTimer timer(Phase::Write, entry.size);
+
+#ifdef _WIN32
+    if (entry.size == 0) {
+        // Create empty file
+        FILE *exportFile = _wfopen(filePath.c_str(), L"wb");
+
+        if (exportFile == nullptr)
+            throw ResourceError("Failed to open " + filePath.string() + " for writing.");
+
+        fclose(exportFile);
+        return;
+    }
+
+    MemoryMappedFile *outFile;
+
+    try {
+        outFile = new MemoryMappedFile(filePath, entry.size, true, true);
+    }
+    catch (const std::exception &e) {
+        throw ResourceError("Failed to open " + filePath.string() + " for writing.");
+    }
+
+    memcpy(outFile->memp, data, entry.size);
+    delete outFile;
+#else
+    FILE *exportFile = fopen(filePath.c_str(), "wb");
+
+    if (exportFile == nullptr)
+        throw ResourceError("Failed to open " + filePath.string() + " for writing: " + strerror(errno));
+
+    if (fwrite(data, 1, entry.size, exportFile) != entry.size) {
+        fclose(exportFile);
+        throw ResourceError("Failed to write " + filePath.string() + ": " + strerror(errno));
+    }
+
+    fclose(exportFile);
+#endif
+}
+
+// Writes a file in the out directory piece by piece
+// Files are written sparse if given a sink to record the bytes actually written in
+class DirectoryFileWriter : public FileWriter {
+public:
+    DirectoryFileWriter(const fs::path &filePath, DirectorySink *sparseSink) : filePath(filePath), sparseSink(sparseSink)
+    {
+#ifdef _WIN32
+        exportFile = _wfopen(filePath.c_str(), L"wb");
+#else
+        exportFile = fopen(filePath.c_str(), "wb");
+#endif
+
+        if (exportFile == nullptr)
+            throw ResourceError("Failed to open " + filePath.string() + " for writing: " + strerror(errno));
+
+        if (sparseSink != nullptr)
+            markSparse(exportFile);
+    }
+
+    ~DirectoryFileWriter() override
+    {
+        // Drop the file if it wasn't completely written
+        if (exportFile != nullptr) {
+            fclose(exportFile);
+
+            std::error_code ec;
+            fs::remove(filePath, ec);
+        }
+    }
+
+    void write(const unsigned char *data, size_t size) override
+    {
+        PhaseTimer timer(Phase::Write, size);
+        uint64_t writtenSize = 0;
+
+        if (sparseSink == nullptr ? fwrite(data, 1, size, exportFile) != size : !writeSparse(exportFile, data, size, position, writtenSize))
+            throw ResourceError("Failed to write " + filePath.string() + ": " + strerror(errno));
+
+        position += size;
+
+        if (sparseSink != nullptr)
+            sparseSink->recordSparseWrite(size, writtenSize);
+    }
+
+    void close() override
+    {
+        if (sparseSink != nullptr && !endSparse(exportFile, position))
+            throw ResourceError("Failed to write " + filePath.string() + ": " + strerror(errno));
+
+        int result = fclose(exportFile);
+        exportFile = nullptr;
+
+        if (result != 0)
+            throw ResourceError("Failed to write " + filePath.string() + ": " + strerror(errno));
+    }
+private:
+    fs::path filePath;
+    DirectorySink *sparseSink;
+    FILE *exportFile;
+    uint64_t position = 0;
+};
+
+// Writes a file in the out directory as an unnamed file, or under a temporary name if the filesystem doesn't support
+// those, then links or renames it to its path once complete. Files are written sparse if given a sink like
+// DirectoryFileWriter.
+class AtomicFileWriter : public FileWriter {
+public:
+    AtomicFileWriter(const fs::path &filePath, DirectorySink *sparseSink) : filePath(filePath), sparseSink(sparseSink)
+    {
+#if !defined(_WIN32) && defined(O_TMPFILE)
+        // Unnamed files are freed if extraction is killed, so nothing is left behind
+        // Opened for reading too, to copy it out if it can't be linked
+        int descriptor = open(filePath.parent_path().c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0644);
+
+        if (descriptor != -1) {
+            exportFile = fdopen(descriptor, "w+b");
+
+            if (exportFile != nullptr)
+                return;
+
+            ::close(descriptor);
+        }
+#endif
+
+        tempPath = filePath;
+        tempPath += ".part";
+
+#ifdef _WIN32
+        exportFile = _wfopen(tempPath.c_str(), L"wb");
+#else
+        exportFile = fopen(tempPath.c_str(), "wb");
+#endif
+
+        if (exportFile == nullptr)
+            throw ResourceError("Failed to open " + tempPath.string() + " for writing: " + strerror(errno));
+
+        if (sparseSink != nullptr)
+            markSparse(exportFile);
+    }
+
+    ~AtomicFileWriter() override
+    {
+        if (exportFile != nullptr)
+            fclose(exportFile);
+
+        // Drop the incomplete file
+        if (!tempPath.empty()) {
+            std::error_code ec;
+            fs::remove(tempPath, ec);
+        }
+    }
+
+    void write(const unsigned char *data, size_t size) override
+    {
+        PhaseTimer timer(Phase::Write, size);
+        uint64_t writtenSize = 0;
+
+        if (sparseSink == nullptr ? fwrite(data, 1, size, exportFile) != size : !writeSparse(exportFile, data, size, position, writtenSize))
+            throw ResourceError("Failed to write " + filePath.string() + ": " + strerror(errno));
+
+        position += size;
+
+        if (sparseSink != nullptr)
+            sparseSink->recordSparseWrite(size, writtenSize);
+    }
+
+    void close() override
+    {
+        if (sparseSink != nullptr ? !endSparse(exportFile, position) : fflush(exportFile) != 0)
+            throw ResourceError("Failed to write " + filePath.string() + ": " + strerror(errno));
+
+#ifndef _WIN32
+        if (tempPath.empty()) {
+            std::string descriptorPath = "/proc/self/fd/" + std::to_string(fileno(exportFile));
+
+            // Give the unnamed file its path, or a temporary one to replace an existing file with
+            if (linkat(AT_FDCWD, descriptorPath.c_str(), AT_FDCWD, filePath.c_str(), AT_SYMLINK_FOLLOW) == 0) {
+                closeFile();
+                return;
+            }
+
+            tempPath = filePath;
+            tempPath += ".part";
+            unlink(tempPath.c_str());
+
+            // Without /proc it can't be linked at all, so its contents are copied instead
+            if (linkat(AT_FDCWD, descriptorPath.c_str(), AT_FDCWD, tempPath.c_str(), AT_SYMLINK_FOLLOW) != 0)
+                copyToTempPath();
+        }
+#endif
+
+        closeFile();
+
+        std::error_code ec;
+        fs::rename(tempPath, filePath, ec);
+
+        if (ec.value() != 0)
+            throw ResourceError("Failed to write " + filePath.string() + ": " + ec.message());
+
+        tempPath.clear();
+    }
+private:
+    fs::path filePath;
+    fs::path tempPath;
+    DirectorySink *sparseSink;
+    FILE *exportFile;
+    uint64_t position = 0;
+
+    void closeFile()
+    {
+        int result = fclose(exportFile);
+        exportFile = nullptr;
+
+        if (result != 0)
+            throw ResourceError("Failed to write " + filePath.string() + ": " + strerror(errno));
+    }
+
+#ifndef _WIN32
+    // Copy the complete unnamed file to the temporary path, skipping its blocks of zeros again if it's sparse
+    void copyToTempPath()
+    {
+        FILE *tempFile = fopen(tempPath.c_str(), "wb");
+
+        if (tempFile == nullptr) {
+            int error = errno;
+            tempPath.clear();
+            throw ResourceError("Failed to open " + filePath.string() + ".part for writing: " + strerror(error));
+        }
+
+        std::vector<unsigned char> chunk(static_cast<size_t>(std::min<uint64_t>(position, 1 << 20)));
+        bool success = fseeko(exportFile, 0, SEEK_SET) == 0;
+
+        for (uint64_t copied = 0; success && copied < position; copied += chunk.size()) {
+            chunk.resize(static_cast<size_t>(std::min<uint64_t>(chunk.size(), position - copied)));
+            uint64_t writtenSize = 0;
+
+            success = fread(chunk.data(), 1, chunk.size(), exportFile) == chunk.size()
+                && (sparseSink == nullptr ? fwrite(chunk.data(), 1, chunk.size(), tempFile) == chunk.size() : writeSparse(tempFile, chunk.data(), chunk.size(), copied, writtenSize));
+        }
+
+        success = (sparseSink == nullptr || endSparse(tempFile, position)) && success;
+        success = fclose(tempFile) == 0 && success;
+
+        if (!success)
+            throw ResourceError("Failed to write " + filePath.string() + ": " + strerror(errno));
+    }
+#endif
+};
+
+// Open file in the out directory to be written in pieces
+std::unique_ptr<FileWriter> DirectorySink::openFile(const ResourceEntry &entry)
+{
+    DirectorySink *sparseSink = sparse ? this : nullptr;
+
+    if (atomic)
+        return std::unique_ptr<FileWriter>(new AtomicFileWriter(createFilePath(entry), sparseSink));
+
+    return std::unique_ptr<FileWriter>(new DirectoryFileWriter(createFilePath(entry), sparseSink));
+}
+
+// Add a file's piece to the totals of sparse output, size being the bytes given and writtenSize the bytes written
+void DirectorySink::recordSparseWrite(uint64_t size, uint64_t writtenSize)
+{
+    logicalBytes += size;
+    writtenBytes += writtenSize;
+}
+
+// TarSink constructor, "-" streams the archive to stdout
+TarSink::TarSink(const std::string &tarPath) : tarPath(tarPath)
+{
+    if (tarPath == "-") {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        tarFile = stdout;
+    }
+    else {
+#ifdef _WIN32
+        tarFile = _wfopen(fs::path(tarPath).c_str(), L"wb");
+#else
+        tarFile = fopen(tarPath.c_str(), "wb");
+#endif
+    }
+
+    if (tarFile == nullptr)
+        throw ResourceError("Failed to open " + tarPath + " for writing: " + strerror(errno));
+
+    setvbuf(tarFile, nullptr, _IOFBF, 1 << 20);
+}
+
+// TarSink destructor
+TarSink::~TarSink()
+{
+    if (tarFile != stdout)
+        fclose(tarFile);
+}
+
+// Write bytes to the tar file
+void TarSink::writeBytes(const void *data, size_t size)
+{
+    if (fwrite(data, 1, size, tarFile) != size)
+        throw ResourceError("Failed to write to " + tarPath + ": " + strerror(errno));
+}
+
+// Pad the tar file to the next 512-byte block
+void TarSink::writePadding(uint64_t size)
+{
+    static const std::array<char, 512> zeroes{};
+
+    if (size % 512 != 0)
+        writeBytes(zeroes.data(), 512 - size % 512);
+}
+
+// Write octal number into a tar header field
+static void writeOctal(char *field, size_t fieldSize, uint64_t value)
+{
+    snprintf(field, fieldSize, "%0*llo", static_cast<int>(fieldSize - 1), static_cast<unsigned long long>(value));
+}
+
+// Build pax extended header record ("<length> <key>=<value>\n")
+static std::string paxRecord(const std::string &key, const std::string &value)
+{
+    size_t baseLength = key.length() + value.length() + 3;
+    size_t length = baseLength + std::to_string(baseLength).length();
+
+    while (std::to_string(length).length() + baseLength != length)
+        length = std::to_string(length).length() + baseLength;
+
+    return std::to_string(length) + " " + key + "=" + value + "\n";
+}
+
+// Write ustar header, preceded by a pax header if the name or size don't fit
+void TarSink::writeHeader(const std::string &name, uint64_t size, char type)
+{
+    static const uint64_t maxOctalSize = 077777777777ULL;
+
+    if (type != 'x' && (name.length() > 100 || size > maxOctalSize)) {
+        std::string pax;
+
+        if (name.length() > 100)
+            pax += paxRecord("path", name);
+
+        if (size > maxOctalSize)
+            pax += paxRecord("size", std::to_string(size));
+
+        writeHeader("PaxHeader", pax.length(), 'x');
+        writeBytes(pax.data(), pax.length());
+        writePadding(pax.length());
+    }
+
+    std::array<char, 512> header{};
+    memcpy(header.data(), name.data(), std::min<size_t>(name.length(), 100));
+    writeOctal(header.data() + 100, 8, 0644);
+    writeOctal(header.data() + 108, 8, 0);
+    writeOctal(header.data() + 116, 8, 0);
+    writeOctal(header.data() + 124, 12, std::min(size, maxOctalSize));
+    writeOctal(header.data() + 136, 12, 0);
+    header[156] = type;
+    memcpy(header.data() + 257, "ustar", 6);
+    memcpy(header.data() + 263, "00", 2);
+
+    // Checksum is computed with the checksum field filled with spaces
+    memset(header.data() + 148, ' ', 8);
+    unsigned int checksum = 0;
+
+    for (char c : header)
+        checksum += static_cast<unsigned char>(c);
+
+    snprintf(header.data() + 148, 8, "%06o", checksum);
+    writeBytes(header.data(), header.size());
+}
+
+// Append file to the tar archive
+void TarSink::writeFile(const ResourceEntry &entry, const unsigned char *data)
+{
+    PhaseTimer timer(Phase::Write, entry.size);
+    writeHeader(entry.name, entry.size, '0');
+    writeBytes(data, entry.size);
+    writePadding(entry.size);
+}
+
+// Appends a file to the tar archive piece by piece, after its header
+class TarSink::TarFileWriter : public FileWriter {
+public:
+    TarFileWriter(TarSink &sink, const ResourceEntry &entry) : sink(sink), entry(entry)
+    {
+        sink.writeHeader(entry.name, entry.size, '0');
+    }
+
+    void write(const unsigned char *data, size_t size) override
+    {
+        PhaseTimer timer(Phase::Write, size);
+        sink.writeBytes(data, size);
+    }
+
+    void close() override
+    {
+        sink.writePadding(entry.size);
+    }
+private:
+    TarSink &sink;
+    const ResourceEntry &entry;
+};
+
+// Open file in the tar archive to be written in pieces
+std::unique_ptr<FileWriter> TarSink::openFile(const ResourceEntry &entry)
+{
+    return std::unique_ptr<FileWriter>(new TarFileWriter(*this, entry));
+}
+
+// Write the end of archive marker and flush
+void TarSink::finish()
+{
+    static const std::array<char, 1024> zeroes{};
+    writeBytes(zeroes.data(), zeroes.size());
+
+    if (fflush(tarFile) != 0)
+        throw ResourceError("Failed to write to " + tarPath + ": " + strerror(errno));
+}
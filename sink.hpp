@@ -0,0 +1,91 @@
+#ifndef SINK_HPP
+#define SINK_HPP
+
+#include <cstdio>
+#include <string>
+#include <memory>
+#include <atomic>
+#include "archive.hpp"
+
+// Size and alignment of the zero blocks skipped in sparse output, the usual filesystem block size
+#define SPARSE_BLOCK_SIZE 4096
+
+// Receives the data of a single file in order, piece by piece
+class FileWriter {
+public:
+    virtual ~FileWriter() = default;
+
+    // Append the next piece of the file
+    virtual void write(const unsigned char *data, size_t size) = 0;
+
+    // Finish the file after all of its entry.size bytes were written
+    virtual void close() = 0;
+};
+
+// Destination for extracted files
+class OutputSink {
+public:
+    virtual ~OutputSink() = default;
+
+    // Write the entry's decompressed data, which is entry.size bytes long
+    virtual void writeFile(const ResourceEntry &entry, const unsigned char *data) = 0;
+
+    // Open the entry to be written in pieces, for files too large to be held in memory
+    // The default implementation collects the pieces and passes them to writeFile
+    virtual std::unique_ptr<FileWriter> openFile(const ResourceEntry &entry);
+
+    // Called when a file fails to extract, return true to carry on with the next ones instead of stopping
+    virtual bool fileFailed(const ResourceEntry&, const std::string&) { return false; }
+
+    // Flush any pending output after the last file
+    virtual void finish() {}
+
+    // Whether files should be written in data offset order
+    virtual bool sequential() const { return false; }
+};
+
+// Writes every file into a directory tree
+// Atomic sinks publish each file at its path only once it's complete, so killing extraction leaves no truncated files
+// Sparse sinks seek over blocks of zeros instead of writing them, so the filesystem can leave holes there
+class DirectorySink : public OutputSink {
+public:
+    std::string outPath;
+    bool atomic;
+    bool sparse;
+
+    explicit DirectorySink(const std::string &outPath, bool atomic = false, bool sparse = false);
+    void writeFile(const ResourceEntry &entry, const unsigned char *data) override;
+    std::unique_ptr<FileWriter> openFile(const ResourceEntry &entry) override;
+
+    void recordSparseWrite(uint64_t size, uint64_t writtenSize);
+    uint64_t bytesLogical() const { return logicalBytes; }
+    uint64_t bytesWritten() const { return writtenBytes; }
+private:
+    std::atomic<uint64_t> logicalBytes;
+    std::atomic<uint64_t> writtenBytes;
+
+    fs::path createFilePath(const ResourceEntry &entry);
+};
+
+// Streams every file into a tar archive
+class TarSink : public OutputSink {
+public:
+    explicit TarSink(const std::string &tarPath);
+    ~TarSink() override;
+
+    void writeFile(const ResourceEntry &entry, const unsigned char *data) override;
+    std::unique_ptr<FileWriter> openFile(const ResourceEntry &entry) override;
+    void finish() override;
+    bool sequential() const override { return true; }
+private:
+    class TarFileWriter;
+
+    std::string tarPath;
+    FILE *tarFile;
+
+    void writeBytes(const void *data, size_t size);
+    void writeHeader(const std::string &name, uint64_t size, char type);
+    void writePadding(uint64_t size);
+};
+
+#endif
@@ -0,0 +1,185 @@
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "sniff.hpp"
+
+// Type identified by a fixed byte sequence at an offset
+struct MagicType {
+    const char *type;
+    size_t offset;
+    const char *magic;
+    size_t length;
+};
+
+static const MagicType magicTypes[] = {
+    {"bimage", 0, "BIM", 3},
+    {"png", 0, "\x89PNG\r\n\x1a\n", 8},
+    {"jpeg", 0, "\xff\xd8\xff", 3},
+    {"gif", 0, "GIF8", 4},
+    {"wav", 8, "WAVE", 4},
+    {"webp", 8, "WEBP", 4},
+    {"ogg", 0, "OggS", 4},
+    {"flac", 0, "fLaC", 4},
+    {"mp3", 0, "ID3", 3},
+    {"wwise-bank", 0, "BKHD", 4},
+    {"wwise-package", 0, "AKPK", 4},
+    {"bink2", 0, "KB2", 3},
+    {"bink", 0, "BIK", 3},
+    {"zip", 0, "PK\x03\x04", 4},
+    {"gzip", 0, "\x1f\x8b", 2},
+    {"zstd", 0, "\x28\xb5\x2f\xfd", 4},
+    {"resources", 0, "IDCL", 4},
+    {"elf", 0, "\x7f" "ELF", 4},
+    {"dxbc", 0, "DXBC", 4},
+    {"spirv", 0, "\x03\x02\x23\x07", 4},
+    {"gltf", 0, "glTF", 4},
+    {"pdf", 0, "%PDF", 4},
+};
+
+// Block compressed formats by DDS four character code
+static const std::pair<const char*, const char*> ddsFourCCs[] = {
+    {"DXT1", "dds-bc1"}, {"DXT2", "dds-bc2"}, {"DXT3", "dds-bc2"}, {"DXT4", "dds-bc3"}, {"DXT5", "dds-bc3"},
+    {"ATI1", "dds-bc4"}, {"BC4U", "dds-bc4"}, {"BC4S", "dds-bc4"}, {"ATI2", "dds-bc5"}, {"BC5U", "dds-bc5"}, {"BC5S", "dds-bc5"}
+};
+
+// Get the block compression of a DDS texture from its header
+static std::string ddsType(const unsigned char *data, size_t size)
+{
+    if (size < 88)
+        return "dds";
+
+    if (memcmp(data + 84, "DX10", 4) == 0 && size >= 132) {
+        uint32_t format = data[128] | (data[129] << 8) | (data[130] << 16) | (static_cast<uint32_t>(data[131]) << 24);
+
+        // DXGI_FORMAT_BC1_TYPELESS to DXGI_FORMAT_BC5_SNORM, then BC6H and BC7
+        if (format >= 70 && format <= 84)
+            return "dds-bc" + std::to_string((format - 70) / 3 + 1);
+
+        if (format >= 94 && format <= 99)
+            return format <= 96 ? "dds-bc6h" : "dds-bc7";
+
+        return "dds";
+    }
+
+    for (const auto &fourCC : ddsFourCCs) {
+        if (memcmp(data + 84, fourCC.first, 4) == 0)
+            return fourCC.second;
+    }
+
+    return "dds";
+}
+
+// Tell text formats apart by their first characters, or return an empty string for binary data
+static std::string textType(const unsigned char *data, size_t size)
+{
+    // Skip UTF-8 byte order mark
+    if (size >= 3 && memcmp(data, "\xef\xbb\xbf", 3) == 0) {
+        data += 3;
+        size -= 3;
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] < 0x20 && data[i] != '\t' && data[i] != '\n' && data[i] != '\r' && data[i] != '\f')
+            return "";
+    }
+
+    auto skipSpace = [&](size_t position) {
+        while (position < size && isspace(data[position]))
+            position++;
+
+        return position;
+    };
+
+    size_t position = skipSpace(0);
+
+    if (position == size)
+        return "text";
+
+    if (data[position] == '[')
+        return "json";
+
+    if (data[position] == '<')
+        return "xml";
+
+    // Decls are blocks of unquoted keys, JSON objects have quoted ones
+    if (data[position] == '{') {
+        size_t next = skipSpace(position + 1);
+
+        if (next < size && (data[next] == '"' || data[next] == '}'))
+            return "json";
+
+        return "decl";
+    }
+
+    return "text";
+}
+
+// Detect a file's type from its first bytes
+std::string sniffType(const unsigned char *data, size_t size, uint64_t fileSize)
+{
+    if (fileSize == 0)
+        return "empty";
+
+    if (size >= 4 && memcmp(data, "DDS ", 4) == 0)
+        return ddsType(data, size);
+
+    for (const auto &magicType : magicTypes) {
+        if (size >= magicType.offset + magicType.length && memcmp(data + magicType.offset, magicType.magic, magicType.length) == 0)
+            return magicType.type;
+    }
+
+    std::string type = textType(data, size);
+    return type.empty() ? "binary" : type;
+}
+
+// Check whether a detected type is one of the given ones, "dds" also matches every "dds-" subtype
+bool matchesType(const std::string &type, const std::vector<std::string> &types)
+{
+    for (const auto &wanted : types) {
+        if (type == wanted || (type.length() > wanted.length() && type.compare(0, wanted.length(), wanted) == 0 && type[wanted.length()] == '-'))
+            return true;
+    }
+
+    return false;
+}
+
+// Detect the type of every entry on up to threadCount threads, only decoding the first block of compressed ones
+// Entries that fail to decode are of the "corrupt" type
+std::vector<std::string> sniffTypes(const ResourceArchive &archive, const std::vector<const ResourceEntry*> &entries, unsigned int threadCount)
+{
+    std::vector<std::string> types(entries.size());
+    std::atomic<size_t> nextEntry(0);
+
+    auto sniffWorker = [&]() {
+        std::unique_ptr<unsigned char[]> buffer;
+
+        for (size_t i = nextEntry++; i < entries.size(); i = nextEntry++) {
+            size_t length = SNIFF_SIZE;
+
+            try {
+                const unsigned char *data = archive.peekEntry(*entries[i], buffer, length);
+                types[i] = sniffType(data, std::min<size_t>(length, SNIFF_SIZE), entries[i]->size);
+            }
+            catch (const ResourceError &e) {
+                types[i] = "corrupt";
+            }
+        }
+    };
+
+    if (threadCount <= 1) {
+        sniffWorker();
+    }
+    else {
+        std::vector<std::thread> threads;
+
+        for (unsigned int i = 0; i < threadCount; i++)
+            threads.emplace_back(sniffWorker);
+
+        for (auto &thread : threads)
+            thread.join();
+    }
+
+    return types;
+}
@@ -0,0 +1,15 @@
+#ifndef SNIFF_HPP
+#define SNIFF_HPP
+
+#include <string>
+#include <vector>
+#include "archive.hpp"
+
+// Bytes from the start of each file used to detect its type
+#define SNIFF_SIZE 4096
+
+std::string sniffType(const unsigned char *data, size_t size, uint64_t fileSize);
+bool matchesType(const std::string &type, const std::vector<std::string> &types);
+std::vector<std::string> sniffTypes(const ResourceArchive &archive, const std::vector<const ResourceEntry*> &entries, unsigned int threadCount);
+
+#endif
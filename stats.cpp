@@ -0,0 +1,271 @@
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "stats.hpp"
+#include "archive.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+bool statsEnabled = false;
+
+static std::mutex threadStatsMutex;
+static std::vector<std::unique_ptr<ThreadStats>> allThreadStats;
+
+static const char *phaseNames[] = {"parse", "filter", "mkpath", "decompress", "write"};
+static const char *sizeBucketNames[] = {"<4K", "<64K", "<1M", "<16M", ">=16M"};
+
+// Add sample to the histogram
+void LatencyHistogram::record(uint64_t nanoseconds)
+{
+    size_t bucket = 0;
+
+    while (bucket < LATENCY_BUCKET_COUNT - 1 && (1ULL << bucket) < nanoseconds)
+        bucket++;
+
+    buckets[bucket]++;
+    count++;
+    totalNanoseconds += nanoseconds;
+    maxNanoseconds = std::max(maxNanoseconds, nanoseconds);
+}
+
+// Add all samples from another histogram
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    for (size_t i = 0; i < LATENCY_BUCKET_COUNT; i++)
+        buckets[i] += other.buckets[i];
+
+    count += other.count;
+    totalNanoseconds += other.totalNanoseconds;
+    maxNanoseconds = std::max(maxNanoseconds, other.maxNanoseconds);
+}
+
+// Get the calling thread's counters, registering them on first use
+ThreadStats &currentThreadStats()
+{
+    thread_local ThreadStats *threadStats = nullptr;
+
+    if (threadStats == nullptr) {
+        std::lock_guard<std::mutex> lock(threadStatsMutex);
+        allThreadStats.emplace_back(new ThreadStats());
+        threadStats = allThreadStats.back().get();
+    }
+
+    return *threadStats;
+}
+
+// Count an extracted file on the calling thread
+void recordFileStats(uint64_t bytesIn, uint64_t bytesOut)
+{
+    if (!statsEnabled)
+        return;
+
+    ThreadStats &threadStats = currentThreadStats();
+    threadStats.files++;
+    threadStats.bytesIn += bytesIn;
+    threadStats.bytesOut += bytesOut;
+}
+
+// Sum the time spent in a phase and the bytes it handled over all threads
+void phaseTotals(Phase phase, double &seconds, uint64_t &bytes)
+{
+    std::lock_guard<std::mutex> lock(threadStatsMutex);
+    uint64_t nanoseconds = 0;
+    bytes = 0;
+
+    for (const auto &threadStats : allThreadStats) {
+        nanoseconds += threadStats->phases[static_cast<size_t>(phase)].totalNanoseconds;
+        bytes += threadStats->phaseBytes[static_cast<size_t>(phase)];
+    }
+
+    seconds = nanoseconds / 1e9;
+}
+
+// PhaseTimer constructor
+PhaseTimer::PhaseTimer(Phase phase, uint64_t size) : phase(phase), size(size)
+{
+    if (statsEnabled)
+        begin = std::chrono::steady_clock::now();
+}
+
+// PhaseTimer destructor
+PhaseTimer::~PhaseTimer()
+{
+    if (!statsEnabled)
+        return;
+
+    uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    size_t sizeBucket = 0;
+
+    while (sizeBucket < SIZE_BUCKET_COUNT - 1 && size >= (4096ULL << (4 * sizeBucket)))
+        sizeBucket++;
+
+    ThreadStats &threadStats = currentThreadStats();
+    threadStats.phases[static_cast<size_t>(phase)].record(nanoseconds);
+    threadStats.phaseBytes[static_cast<size_t>(phase)] += size;
+    threadStats.phaseSizes[static_cast<size_t>(phase)][sizeBucket].record(nanoseconds);
+}
+
+// Escape string for JSON output
+static std::string escapeJson(const std::string &string)
+{
+    std::string escaped;
+
+    for (char c : string) {
+        if (c == '"' || c == '\\') {
+            escaped.push_back('\\');
+            escaped.push_back(c);
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            char code[7];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        }
+        else {
+            escaped.push_back(c);
+        }
+    }
+
+    return escaped;
+}
+
+// Write histogram as a JSON object
+static void writeHistogramJson(FILE *file, const LatencyHistogram &histogram)
+{
+    fprintf(file, "{\"count\": %llu, \"totalSeconds\": %.9f, \"maxSeconds\": %.9f, \"buckets\": [",
+        static_cast<unsigned long long>(histogram.count), histogram.totalNanoseconds / 1e9, histogram.maxNanoseconds / 1e9);
+
+    bool first = true;
+
+    for (size_t i = 0; i < LATENCY_BUCKET_COUNT; i++) {
+        if (histogram.buckets[i] == 0)
+            continue;
+
+        fprintf(file, "%s{\"leNanoseconds\": %llu, \"count\": %llu}", first ? "" : ", ", 1ULL << i, static_cast<unsigned long long>(histogram.buckets[i]));
+        first = false;
+    }
+
+    fprintf(file, "]}");
+}
+
+// Write process wide resource usage as a JSON object
+static void writeProcessJson(FILE *file)
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS memoryCounters = {};
+    IO_COUNTERS ioCounters = {};
+    GetProcessMemoryInfo(GetCurrentProcess(), &memoryCounters, sizeof(memoryCounters));
+    GetProcessIoCounters(GetCurrentProcess(), &ioCounters);
+
+    fprintf(file, "{\"peakRssBytes\": %llu, \"pageFaults\": %llu, \"readSyscalls\": %llu, \"writeSyscalls\": %llu, \"readBytes\": %llu, \"writeBytes\": %llu}",
+        static_cast<unsigned long long>(memoryCounters.PeakWorkingSetSize), static_cast<unsigned long long>(memoryCounters.PageFaultCount),
+        ioCounters.ReadOperationCount, ioCounters.WriteOperationCount, ioCounters.ReadTransferCount, ioCounters.WriteTransferCount);
+#else
+    struct rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+
+    fprintf(file, "{\"peakRssBytes\": %llu, \"majorFaults\": %ld, \"minorFaults\": %ld, \"voluntaryContextSwitches\": %ld, \"involuntaryContextSwitches\": %ld",
+        static_cast<unsigned long long>(usage.ru_maxrss) * 1024, usage.ru_majflt, usage.ru_minflt, usage.ru_nvcsw, usage.ru_nivcsw);
+
+    // Syscall counts are only available on Linux
+    FILE *ioFile = fopen("/proc/self/io", "r");
+
+    if (ioFile != nullptr) {
+        char key[32];
+        unsigned long long value;
+
+        while (fscanf(ioFile, "%31[^:]: %llu ", key, &value) == 2) {
+            if (strcmp(key, "syscr") == 0)
+                fprintf(file, ", \"readSyscalls\": %llu", value);
+            else if (strcmp(key, "syscw") == 0)
+                fprintf(file, ", \"writeSyscalls\": %llu", value);
+            else if (strcmp(key, "rchar") == 0)
+                fprintf(file, ", \"readBytes\": %llu", value);
+            else if (strcmp(key, "wchar") == 0)
+                fprintf(file, ", \"writeBytes\": %llu", value);
+        }
+
+        fclose(ioFile);
+    }
+
+    fprintf(file, "}");
+#endif
+}
+
+// Write all recorded stats to a JSON file
+void writeStatsJson(const std::string &path, const std::string &archivePath, double wallSeconds)
+{
+#ifdef _WIN32
+    FILE *file = _wfopen(fs::path(path).c_str(), L"w");
+#else
+    FILE *file = fopen(path.c_str(), "w");
+#endif
+
+    if (file == nullptr)
+        throw ResourceError("Failed to open " + path + " for writing: " + strerror(errno));
+
+    std::lock_guard<std::mutex> lock(threadStatsMutex);
+    ThreadStats total;
+
+    for (const auto &threadStats : allThreadStats) {
+        total.files += threadStats->files;
+        total.bytesIn += threadStats->bytesIn;
+        total.bytesOut += threadStats->bytesOut;
+
+        for (size_t phase = 0; phase < static_cast<size_t>(Phase::Count); phase++) {
+            total.phases[phase].merge(threadStats->phases[phase]);
+
+            for (size_t sizeBucket = 0; sizeBucket < SIZE_BUCKET_COUNT; sizeBucket++)
+                total.phaseSizes[phase][sizeBucket].merge(threadStats->phaseSizes[phase][sizeBucket]);
+        }
+    }
+
+    fprintf(file, "{\n  \"archive\": \"%s\",\n  \"wallSeconds\": %.6f,\n  \"files\": %llu,\n  \"bytesIn\": %llu,\n  \"bytesOut\": %llu,\n",
+        escapeJson(archivePath).c_str(), wallSeconds, static_cast<unsigned long long>(total.files),
+        static_cast<unsigned long long>(total.bytesIn), static_cast<unsigned long long>(total.bytesOut));
+
+    // Per phase histograms, overall and by file size
+    fprintf(file, "  \"phases\": {");
+
+    for (size_t phase = 0; phase < static_cast<size_t>(Phase::Count); phase++) {
+        fprintf(file, "%s\n    \"%s\": ", phase == 0 ? "" : ",", phaseNames[phase]);
+        writeHistogramJson(file, total.phases[phase]);
+        fprintf(file, ",\n    \"%sBySize\": {", phaseNames[phase]);
+
+        for (size_t sizeBucket = 0; sizeBucket < SIZE_BUCKET_COUNT; sizeBucket++) {
+            fprintf(file, "%s\n      \"%s\": ", sizeBucket == 0 ? "" : ",", sizeBucketNames[sizeBucket]);
+            writeHistogramJson(file, total.phaseSizes[phase][sizeBucket]);
+        }
+
+        fprintf(file, "\n    }");
+    }
+
+    // Per thread totals
+    fprintf(file, "\n  },\n  \"threads\": [");
+
+    for (size_t i = 0; i < allThreadStats.size(); i++) {
+        const auto &threadStats = allThreadStats[i];
+        fprintf(file, "%s\n    {\"files\": %llu, \"bytesIn\": %llu, \"bytesOut\": %llu", i == 0 ? "" : ",",
+            static_cast<unsigned long long>(threadStats->files), static_cast<unsigned long long>(threadStats->bytesIn),
+            static_cast<unsigned long long>(threadStats->bytesOut));
+
+        for (size_t phase = 0; phase < static_cast<size_t>(Phase::Count); phase++)
+            fprintf(file, ", \"%sSeconds\": %.9f", phaseNames[phase], threadStats->phases[phase].totalNanoseconds / 1e9);
+
+        fprintf(file, "}");
+    }
+
+    fprintf(file, "\n  ],\n  \"process\": ");
+    writeProcessJson(file);
+    fprintf(file, "\n}\n");
+
+    if (fclose(file) != 0)
+        throw ResourceError("Failed to write " + path + ": " + strerror(errno));
+}
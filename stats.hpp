@@ -0,0 +1,64 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <array>
+#include <chrono>
+#include <string>
+
+#define LATENCY_BUCKET_COUNT 40
+#define SIZE_BUCKET_COUNT 5
+
+// Extraction phases with timing instrumentation
+enum class Phase {
+    Parse,
+    Filter,
+    Mkpath,
+    Decompress,
+    Write,
+    Count
+};
+
+// Latency histogram with power of two nanosecond buckets
+struct LatencyHistogram {
+    uint64_t count = 0;
+    uint64_t totalNanoseconds = 0;
+    uint64_t maxNanoseconds = 0;
+    std::array<uint64_t, LATENCY_BUCKET_COUNT> buckets{};
+
+    void record(uint64_t nanoseconds);
+    void merge(const LatencyHistogram &other);
+};
+
+// Counters owned by a single thread, so recording never needs a lock
+struct ThreadStats {
+    uint64_t files = 0;
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+    std::array<LatencyHistogram, static_cast<size_t>(Phase::Count)> phases;
+    std::array<uint64_t, static_cast<size_t>(Phase::Count)> phaseBytes{};
+    std::array<std::array<LatencyHistogram, SIZE_BUCKET_COUNT>, static_cast<size_t>(Phase::Count)> phaseSizes;
+};
+
+// Instrumentation is off unless enabled before extraction starts
+extern bool statsEnabled;
+
+ThreadStats &currentThreadStats();
+void recordFileStats(uint64_t bytesIn, uint64_t bytesOut);
+void phaseTotals(Phase phase, double &seconds, uint64_t &bytes);
+void writeStatsJson(const std::string &path, const std::string &archivePath, double wallSeconds);
+
+// Records the time spent in a phase on the current thread while in scope
+class PhaseTimer {
+public:
+    PhaseTimer(Phase phase, uint64_t size);
+    ~PhaseTimer();
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer &operator=(const PhaseTimer&) = delete;
+private:
+    Phase phase;
+    uint64_t size;
+    std::chrono::steady_clock::time_point begin;
+};
+
+#endif
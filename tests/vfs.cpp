@@ -0,0 +1,236 @@
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "archive.hpp"
+#include "pack.hpp"
+#include "vfs.hpp"
+
+static int failures = 0;
+
+// Report a failed check without stopping, so one run shows every failure
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition "\n"; \
+            failures++; \
+        } \
+    } while (false)
+
+// File added to the test archive
+struct TestFile {
+    std::string name;
+    std::vector<unsigned char> data;
+    bool compress;
+};
+
+// Repeated text, so Kraken compresses it
+static std::vector<unsigned char> textData(size_t size)
+{
+    static const char text[] = "The quick brown fox jumps over the lazy dog. ";
+    std::vector<unsigned char> data(size);
+
+    for (size_t i = 0; i < size; i++)
+        data[i] = static_cast<unsigned char>(text[i % (sizeof(text) - 1)]);
+
+    return data;
+}
+
+// Random bytes, stored as they are
+static std::vector<unsigned char> randomData(size_t size, unsigned int seed)
+{
+    std::mt19937 rng(seed);
+    std::vector<unsigned char> data(size);
+
+    for (auto &byte : data)
+        byte = static_cast<unsigned char>(rng());
+
+    return data;
+}
+
+// Write the files into a .resources archive, compressing the ones that ask for it
+static void writeArchive(const std::string &path, const std::vector<TestFile> &files)
+{
+    std::vector<std::string> names;
+
+    for (const auto &file : files)
+        names.push_back(file.name);
+
+    ResourceWriter writer(path, names, 0xD);
+
+    for (const auto &file : files) {
+        if (!file.compress) {
+            writer.addEntry(file.data.size(), file.data.size());
+            writer.write(file.data.data(), file.data.size());
+            continue;
+        }
+
+        std::vector<unsigned char> compressed(file.data.size() + 65536);
+        int zSize = Kraken_Compress(const_cast<unsigned char*>(file.data.data()), file.data.size(), compressed.data(), 4);
+
+        if (zSize <= 0 || static_cast<size_t>(zSize) >= file.data.size())
+            throw ResourceError("Failed to compress " + file.name + ".");
+
+        writer.addEntry(file.data.size(), zSize);
+        writer.write(compressed.data(), zSize);
+    }
+
+    writer.finish();
+}
+
+// Whether the opened file holds exactly the expected bytes
+static bool sameData(const VfsFile &file, const std::vector<unsigned char> &data)
+{
+    return file.size == data.size() && (data.empty() || memcmp(file.data, data.data(), data.size()) == 0);
+}
+
+// Data of the test file with the given name
+static const std::vector<unsigned char> &fileData(const std::vector<TestFile> &files, const std::string &name)
+{
+    for (const auto &file : files) {
+        if (file.name == name)
+            return file.data;
+    }
+
+    throw ResourceError("No test file named " + name + ".");
+}
+
+// Names of a directory's children, in listing order
+static std::vector<std::string> childNames(const ResourceFilesystem &filesystem, const std::string &path)
+{
+    std::vector<std::pair<std::string, VfsStat>> children;
+    std::vector<std::string> names;
+
+    if (filesystem.listDirectory(path, children)) {
+        for (const auto &child : children)
+            names.push_back(child.first);
+    }
+
+    return names;
+}
+
+// Stat, list and open files of a generated archive, and check the cache evicts the least recently used file
+int main()
+{
+    const std::vector<TestFile> files = {
+        {"dir/text.txt", textData(100000), true},
+        {"dir/other.txt", textData(80000), true},
+        {"dir/random.bin", randomData(50000, 1), false},
+        {"dir/big.txt", textData(400000), true},
+        {"dir/third.txt", textData(60000), true},
+        {"empty.txt", {}, false},
+        // Files in the way of a directory are renamed to the first free "<name> (N)"
+        {"file (1)", randomData(10, 2), false},
+        {"file", randomData(20, 3), false},
+        {"file/child", randomData(30, 4), false},
+        {"folder/child", randomData(40, 5), false},
+        {"folder (1)", randomData(50, 6), false},
+        {"folder", randomData(60, 7), false},
+        // Empty path segments are skipped
+        {"/slashes//inside/", randomData(70, 8), false},
+    };
+
+    const std::string archivePath = (fs::temp_directory_path() / "EternalResourceVfsTest.resources").string();
+
+    try {
+        writeArchive(archivePath, files);
+        ResourceArchive archive(archivePath);
+        ResourceFilesystem filesystem(200000);
+        filesystem.addArchive(archive);
+
+        // Stat
+        VfsStat stat;
+        CHECK(filesystem.stat("dir", stat) && stat.isDirectory);
+        CHECK(filesystem.stat("/dir/text.txt", stat) && !stat.isDirectory && stat.size == 100000);
+        CHECK(filesystem.stat("empty.txt", stat) && !stat.isDirectory && stat.size == 0);
+        CHECK(!filesystem.stat("dir/missing.txt", stat));
+
+        // Listing
+        std::vector<std::pair<std::string, VfsStat>> children;
+        CHECK(filesystem.listDirectory("dir", children) && children.size() == 5);
+
+        for (const auto &child : children)
+            CHECK(!child.second.isDirectory && child.second.size > 0);
+
+        CHECK(!filesystem.listDirectory("dir/text.txt", children));
+        CHECK(!filesystem.listDirectory("missing", children));
+        CHECK((childNames(filesystem, "") == std::vector<std::string>{"dir", "empty.txt", "file", "file (1)", "file (2)", "folder", "folder (1)", "folder (2)", "slashes"}));
+
+        // Renamed files
+        CHECK(filesystem.stat("file", stat) && stat.isDirectory);
+        CHECK(filesystem.stat("file (1)", stat) && stat.size == 10);
+        CHECK(filesystem.stat("file (2)", stat) && stat.size == 20);
+        CHECK(filesystem.stat("file/child", stat) && stat.size == 30);
+        CHECK(filesystem.stat("folder", stat) && stat.isDirectory);
+        CHECK(filesystem.stat("folder (1)", stat) && stat.size == 50);
+        CHECK(filesystem.stat("folder (2)", stat) && stat.size == 60);
+
+        // Empty segments
+        CHECK((childNames(filesystem, "slashes") == std::vector<std::string>{"inside"}));
+        CHECK(filesystem.stat("slashes/inside", stat) && !stat.isDirectory && stat.size == 70);
+        CHECK(filesystem.stat("slashes//inside", stat) && stat.size == 70);
+
+        // Opening
+        for (const auto &file : files) {
+            if (file.name == "file" || file.name == "folder" || file.name[0] == '/')
+                continue;
+
+            CHECK(sameData(filesystem.open(file.name), file.data));
+        }
+
+        CHECK(sameData(filesystem.open("file (2)"), fileData(files, "file")));
+        CHECK(sameData(filesystem.open("folder (2)"), fileData(files, "folder")));
+        CHECK(sameData(filesystem.open("slashes/inside"), fileData(files, "/slashes//inside/")));
+
+        bool threw = false;
+
+        try {
+            filesystem.open("dir");
+        }
+        catch (const ResourceError &e) {
+            threw = true;
+        }
+
+        CHECK(threw);
+
+        // Stored files are served from the archive and files larger than the budget aren't cached
+        ResourceFilesystem cached(200000);
+        cached.addArchive(archive);
+        cached.open("dir/random.bin");
+        cached.open("dir/big.txt");
+        CHECK(cached.cachedBytes() == 0);
+
+        // Reopening a cached file makes it the most recently used without adding it again
+        cached.open("dir/text.txt");
+        VfsFile other = cached.open("dir/other.txt");
+        CHECK(cached.cachedBytes() == 180000);
+        cached.open("dir/text.txt");
+        CHECK(cached.cachedBytes() == 180000);
+
+        // Making room for third.txt evicts the least recently used other.txt, which stays valid while it's open
+        cached.open("dir/third.txt");
+        CHECK(cached.cachedBytes() == 160000);
+        CHECK(sameData(other, fileData(files, "dir/other.txt")));
+
+        // Opening other.txt again then evicts third.txt, now the least recently used after text.txt was reopened
+        cached.open("dir/text.txt");
+        CHECK(cached.cachedBytes() == 160000);
+        CHECK(sameData(cached.open("dir/other.txt"), fileData(files, "dir/other.txt")));
+        CHECK(cached.cachedBytes() == 180000);
+    }
+    catch (const ResourceError &e) {
+        std::cerr << "ERROR: " << e.what() << "\n";
+        failures++;
+    }
+
+    fs::remove(archivePath);
+
+    if (failures != 0) {
+        std::cerr << failures << " checks failed.\n";
+        return 1;
+    }
+
+    std::cout << "All checks passed.\n";
+    return 0;
+}
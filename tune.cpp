@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include "tune.hpp"
+#include "archive.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#endif
+
+// WorkerTuner constructor, starts with a single worker unless the number of workers is known
+WorkerTuner::WorkerTuner(unsigned int threadCount, unsigned int knownWorkers) : threadCount(threadCount)
+{
+    workers = knownWorkers != 0 ? std::min(knownWorkers, threadCount) : 1;
+    bestWorkers = workers;
+    settled = knownWorkers != 0 || threadCount == 1;
+    windowStart = std::chrono::steady_clock::now();
+}
+
+// Whether the worker should wait before claiming its next file
+bool WorkerTuner::parked(unsigned int worker) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return worker >= workers && !stopped;
+}
+
+// Wait until the worker can claim files again, returns false if extraction ended meanwhile
+bool WorkerTuner::waitTurn(unsigned int worker)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    workersChanged.wait(lock, [&]() { return worker < workers || stopped; });
+    return !stopped;
+}
+
+// Add an extracted file to the throughput of the current window, moving to the next number of workers at its end
+// Streamed files are decompressed while they're written, so their time counts as writing
+void WorkerTuner::fileDone(uint64_t bytes, double decompressSeconds, double writeSeconds)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    decompressTime += decompressSeconds;
+    writeTime += writeSeconds;
+
+    if (settled)
+        return;
+
+    windowBytes += bytes;
+    windowFiles++;
+
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - windowStart).count();
+
+    if (seconds * 1000 < TUNE_WINDOW_MS || windowFiles < TUNE_MIN_FILES)
+        return;
+
+    double throughput = static_cast<double>(windowBytes) / seconds;
+    windowStart = now;
+    windowBytes = 0;
+    windowFiles = 0;
+
+    if (throughput > bestThroughput * TUNE_MIN_GAIN) {
+        bestThroughput = throughput;
+        bestWorkers = workers;
+
+        if (workers < threadCount) {
+            workers = std::min(workers * 2, threadCount);
+            workersChanged.notify_all();
+            return;
+        }
+    }
+
+    // Extra workers above the best number park before their next file
+    workers = bestWorkers;
+    settled = true;
+    workersChanged.notify_all();
+}
+
+// Let every parked worker go, called once there are no files left to claim
+void WorkerTuner::stop()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+    workersChanged.notify_all();
+}
+
+// Get the number of workers picked, or the best one so far if extraction ended first
+TuningResult WorkerTuner::result() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    double totalTime = decompressTime + writeTime;
+
+    return {
+        settled ? workers : bestWorkers,
+        threadCount,
+        settled,
+        totalTime == 0 ? 0 : decompressTime / totalTime,
+        totalTime == 0 ? 0 : writeTime / totalTime
+    };
+}
+
+// Get an identifier of the device the output is written to, to cache tuned settings by
+std::string outputDevice(const std::string &outputPath)
+{
+    fs::path path = fs::absolute(outputPath);
+
+    // Look at the closest existing directory, the output may not have been created yet
+    std::error_code ec;
+
+    while (!fs::is_directory(path, ec) && path.has_parent_path() && path.parent_path() != path)
+        path = path.parent_path();
+
+#ifdef _WIN32
+    wchar_t volumePath[MAX_PATH + 1];
+
+    if (!GetVolumePathNameW(path.c_str(), volumePath, MAX_PATH + 1))
+        return path.root_name().string();
+
+    return fs::path(volumePath).string();
+#else
+    struct stat status;
+
+    if (stat(path.c_str(), &status) != 0)
+        return "unknown";
+
+    return std::to_string(major(status.st_dev)) + ":" + std::to_string(minor(status.st_dev));
+#endif
+}
+
+// Get the number of workers cached for the device and thread count, or 0 if there's none
+// Each line of the cache has a device, a thread count and the number of workers tuned for them
+unsigned int loadTunedWorkers(const std::string &cachePath, const std::string &device, unsigned int threadCount)
+{
+    std::ifstream cacheFile(fs::path(cachePath), std::ios::binary);
+    std::string line;
+
+    while (std::getline(cacheFile, line)) {
+        std::istringstream fields(line);
+        std::string lineDevice;
+        unsigned int lineThreads;
+        unsigned int lineWorkers;
+
+        if (fields >> std::quoted(lineDevice) >> lineThreads >> lineWorkers && lineDevice == device && lineThreads == threadCount)
+            return lineWorkers;
+    }
+
+    return 0;
+}
+
+// Store the number of workers tuned for the device and thread count, replacing the previous one
+void saveTunedWorkers(const std::string &cachePath, const std::string &device, unsigned int threadCount, unsigned int workers)
+{
+    std::vector<std::string> lines;
+    std::ifstream cacheFile(fs::path(cachePath), std::ios::binary);
+    std::string line;
+
+    while (std::getline(cacheFile, line)) {
+        std::istringstream fields(line);
+        std::string lineDevice;
+        unsigned int lineThreads;
+
+        if (fields >> std::quoted(lineDevice) >> lineThreads && (lineDevice != device || lineThreads != threadCount))
+            lines.push_back(line);
+    }
+
+    cacheFile.close();
+
+    std::ostringstream newLine;
+    newLine << std::quoted(device) << ' ' << threadCount << ' ' << workers;
+    lines.push_back(newLine.str());
+
+    std::ofstream newCacheFile(fs::path(cachePath), std::ios::binary | std::ios::trunc);
+
+    for (const auto &cacheLine : lines)
+        newCacheFile << cacheLine << '\n';
+
+    if (!newCacheFile)
+        throw ResourceError("Failed to write " + cachePath + ".");
+}
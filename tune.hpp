@@ -0,0 +1,63 @@
+#ifndef TUNE_HPP
+#define TUNE_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+// Shortest time to measure throughput with a number of workers for
+#define TUNE_WINDOW_MS 250
+
+// Fewest files that must be extracted in a window for its throughput to be trusted
+#define TUNE_MIN_FILES 4
+
+// Throughput gain needed to keep adding workers
+#define TUNE_MIN_GAIN 1.1
+
+// Settings picked by a WorkerTuner, and where the workers' time went
+struct TuningResult {
+    unsigned int workers;
+    unsigned int threadCount;
+    bool settled;
+    double decompressShare;
+    double writeShare;
+};
+
+// Picks how many workers extract files at once during the first seconds of extraction
+//
+// Starting with one, the number of workers is doubled for as long as each doubling raises the throughput of the
+// next window by TUNE_MIN_GAIN, then set back to the best one. Parked workers don't claim files, their threads help
+// decompress large files instead, so with fast storage the threads end up decompressing files side by side, and with
+// slow storage fewer files are in flight but each is decompressed on several threads. With a number of workers
+// known beforehand, e.g. from a previous run on the same device, it's used as is.
+class WorkerTuner {
+public:
+    explicit WorkerTuner(unsigned int threadCount, unsigned int knownWorkers = 0);
+
+    bool parked(unsigned int worker) const;
+    bool waitTurn(unsigned int worker);
+    void fileDone(uint64_t bytes, double decompressSeconds, double writeSeconds);
+    void stop();
+    TuningResult result() const;
+private:
+    unsigned int threadCount;
+    unsigned int workers;
+    unsigned int bestWorkers;
+    double bestThroughput = 0;
+    bool settled;
+    bool stopped = false;
+    std::chrono::steady_clock::time_point windowStart;
+    uint64_t windowBytes = 0;
+    size_t windowFiles = 0;
+    double decompressTime = 0;
+    double writeTime = 0;
+    mutable std::mutex mutex;
+    std::condition_variable workersChanged;
+};
+
+std::string outputDevice(const std::string &outputPath);
+unsigned int loadTunedWorkers(const std::string &cachePath, const std::string &device, unsigned int threadCount);
+void saveTunedWorkers(const std::string &cachePath, const std::string &device, unsigned int threadCount, unsigned int workers);
+
+#endif
@@ -3,6 +3,7 @@
 #include <vector>
 #include <cstring>
 #include <sys/stat.h>
+#include "archive.hpp"
 #include "utils.hpp"
 
 #ifdef _WIN32
@@ -69,6 +70,41 @@ std::vector<std::string> splitString(std::string stringToSplit, const char delim
     return resultVector;
 }
 
+// Parse byte count with an optional K, M or G suffix
+// stoull would accept leading whitespace and a minus sign, wrapping negative sizes around
+bool parseSize(const std::string &sizeString, uint64_t &size)
+{
+    if (sizeString.empty() || sizeString[0] < '0' || sizeString[0] > '9')
+        return false;
+
+    size_t end;
+
+    try {
+        size = std::stoull(sizeString, &end);
+    }
+    catch (const std::exception &e) {
+        return false;
+    }
+
+    std::string suffix = sizeString.substr(end);
+    int shift = 0;
+
+    if (suffix == "K" || suffix == "k")
+        shift = 10;
+    else if (suffix == "M" || suffix == "m")
+        shift = 20;
+    else if (suffix == "G" || suffix == "g")
+        shift = 30;
+    else if (!suffix.empty())
+        return false;
+
+    if (size > (UINT64_MAX >> shift))
+        return false;
+
+    size <<= shift;
+    return true;
+}
+
 // Recursive mkdir
 #ifdef _WIN32
 int mkpath(const fs::path &filePath, size_t startPos)
@@ -126,11 +162,35 @@ int mkpath(const fs::path &filePath, size_t startPos)
 }
 #endif
 
-// Populate regex resources from parameters
-void compileRegexes(std::vector<std::regex> &regexesToMatch, std::vector<std::regex> &regexesNotToMatch, const std::vector<std::pair<std::string, std::string>> &params)
+// Convert filter using '*' and '?' wildcards into a regex
+std::string filterToRegex(const std::string &filter)
 {
     const std::string charsToEscape = "\\^$*+?.()|{}[]";
-    
+    std::string regex;
+
+    for (const auto& c : filter) {
+        switch (c) {
+            case '?':
+                regex.push_back('.');
+                break;
+            case '*':
+                regex += ".*";
+                break;
+            default:
+                if (charsToEscape.find(c) != std::string::npos)
+                    regex.push_back('\\'); // Escape character with backslash
+
+                regex.push_back(c);
+                break;
+        }
+    }
+
+    return regex;
+}
+
+// Populate regex resources from parameters, throws ResourceError on an invalid expression
+void compileRegexes(std::vector<std::regex> &regexesToMatch, std::vector<std::regex> &regexesNotToMatch, const std::vector<std::pair<std::string, std::string>> &params)
+{
     for (const auto& param : params) {
         if (param.first == "r" || param.first == "regex") {
             for (const auto& regex : splitString(param.second, ';')) {
@@ -142,32 +202,15 @@ void compileRegexes(std::vector<std::regex> &regexesToMatch, std::vector<std::re
                         regexesToMatch.emplace_back(regex, std::regex_constants::ECMAScript | std::regex_constants::optimize);
                 }
                 catch (const std::exception& e) {
-                    throwError("Failed to parse " + regex + " regular expression: " + e.what());
+                    throw ResourceError("Failed to parse " + regex + " regular expression: " + e.what());
                 }
             }
         }
         else if (param.first == "f" || param.first == "filter") {
             for (const auto& filter : splitString(param.second, ';')) {
                 // Convert filter into valid regex
-                std::string regex;
-    
-                for (const auto& c : filter) {
-                    switch (c) {
-                        case '?':
-                            regex.push_back('.');
-                            break;
-                        case '*':
-                            regex += ".*";
-                            break;
-                        default:
-                            if (charsToEscape.find(c) != std::string::npos)
-                                regex.push_back('\\'); // Escape character with backslash
-    
-                            regex.push_back(c);
-                            break;
-                    }
-                }
-    
+                std::string regex = filterToRegex(filter);
+
                 // Push regex to vector
                 try {
                     if (regex[0] == '!')
@@ -176,7 +219,7 @@ void compileRegexes(std::vector<std::regex> &regexesToMatch, std::vector<std::re
                         regexesToMatch.emplace_back(regex, std::regex_constants::ECMAScript | std::regex_constants::optimize);
                 }
                 catch (const std::exception &e) {
-                    throwError("Failed to parse " + filter + " filter: " + e.what());
+                    throw ResourceError("Failed to parse " + filter + " filter: " + e.what());
                 }
             }
         }
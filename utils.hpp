@@ -11,6 +11,8 @@ void pressAnyKey();
 void throwError(const std::string &error);
 std::string formatPath(std::string path);
 std::vector<std::string> splitString(std::string stringToSplit, const char delimiter);
+std::string filterToRegex(const std::string &filter);
+bool parseSize(const std::string &sizeString, uint64_t &size);
 int mkpath(const fs::path &filePath, size_t startPos);
 void compileRegexes(std::vector<std::regex> &regexesToMatch, std::vector<std::regex> &regexesNotToMatch, const std::vector<std::pair<std::string, std::string>> &params);
 
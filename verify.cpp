@@ -0,0 +1,300 @@
+#include <cstring>
+#include <cinttypes>
+#include <algorithm>
+#include "verify.hpp"
+
+static const uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t prime3 = 0x165667B19E3779F9ULL;
+static const uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotateLeft(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t readUint64(const unsigned char *data)
+{
+    uint64_t value = 0;
+
+    for (int i = 7; i >= 0; i--)
+        value = (value << 8) | data[i];
+
+    return value;
+}
+
+// Mix 8 bytes of input into an accumulator
+static inline uint64_t checksumRound(uint64_t accumulator, uint64_t input)
+{
+    return rotateLeft(accumulator + input * prime2, 31) * prime1;
+}
+
+// Checksum constructor
+Checksum::Checksum() : lanes({prime1 + prime2, prime2, 0, 0 - prime1})
+{
+}
+
+// Add the next piece of data
+void Checksum::update(const unsigned char *data, size_t size)
+{
+    totalSize += size;
+
+    // Top up the stripe left over from the last update first
+    if (pendingSize != 0) {
+        size_t fill = std::min(size, pending.size() - pendingSize);
+        memcpy(pending.data() + pendingSize, data, fill);
+        pendingSize += fill;
+        data += fill;
+        size -= fill;
+
+        if (pendingSize < pending.size())
+            return;
+
+        for (size_t i = 0; i < 4; i++)
+            lanes[i] = checksumRound(lanes[i], readUint64(pending.data() + i * 8));
+
+        pendingSize = 0;
+    }
+
+    // Whole 32 byte stripes, one 8 byte lane each
+    for (; size >= 32; data += 32, size -= 32) {
+        lanes[0] = checksumRound(lanes[0], readUint64(data));
+        lanes[1] = checksumRound(lanes[1], readUint64(data + 8));
+        lanes[2] = checksumRound(lanes[2], readUint64(data + 16));
+        lanes[3] = checksumRound(lanes[3], readUint64(data + 24));
+    }
+
+    memcpy(pending.data(), data, size);
+    pendingSize = size;
+}
+
+// Checksum of the data added so far
+uint64_t Checksum::digest() const
+{
+    uint64_t hash;
+
+    if (totalSize >= 32) {
+        hash = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7) + rotateLeft(lanes[2], 12) + rotateLeft(lanes[3], 18);
+
+        for (uint64_t lane : lanes)
+            hash = (hash ^ checksumRound(0, lane)) * prime1 + prime4;
+    }
+    else {
+        hash = prime5;
+    }
+
+    hash += totalSize;
+
+    // Remaining bytes that don't fill a stripe
+    size_t position = 0;
+
+    for (; position + 8 <= pendingSize; position += 8)
+        hash = rotateLeft(hash ^ checksumRound(0, readUint64(pending.data() + position)), 27) * prime1 + prime4;
+
+    if (position + 4 <= pendingSize) {
+        uint64_t value = pending[position] | (pending[position + 1] << 8) | (pending[position + 2] << 16) | (static_cast<uint64_t>(pending[position + 3]) << 24);
+        hash = rotateLeft(hash ^ (value * prime1), 23) * prime2 + prime3;
+        position += 4;
+    }
+
+    for (; position < pendingSize; position++)
+        hash = rotateLeft(hash ^ (pending[position] * prime5), 11) * prime1;
+
+    // Final avalanche
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// Checks a file written in pieces
+class VerifySink::VerifyFileWriter : public FileWriter {
+public:
+    VerifyFileWriter(VerifySink &sink, const ResourceEntry &entry) : sink(sink), entry(entry) {}
+
+    void write(const unsigned char *data, size_t size) override
+    {
+        if (sink.checksums)
+            checksum.update(data, size);
+
+        writtenSize += size;
+    }
+
+    void close() override
+    {
+        sink.fileVerified(entry, writtenSize, checksum.digest());
+    }
+private:
+    VerifySink &sink;
+    const ResourceEntry &entry;
+    Checksum checksum;
+    uint64_t writtenSize = 0;
+};
+
+// VerifySink constructor
+VerifySink::VerifySink(bool checksums) : checksums(checksums), verifiedBytes(0)
+{
+}
+
+// Load checksums to compare against, one "<16 hex digits>  <name>" line per file
+void VerifySink::loadManifest(const std::string &manifestPath)
+{
+#ifdef _WIN32
+    FILE *file = _wfopen(fs::path(manifestPath).c_str(), L"rb");
+#else
+    FILE *file = fopen(manifestPath.c_str(), "rb");
+#endif
+
+    if (file == nullptr)
+        throw ResourceError("Failed to open " + manifestPath + ": " + strerror(errno));
+
+    std::string line;
+    size_t lineNumber = 0;
+
+    for (int c = fgetc(file); c != EOF || !line.empty(); c = fgetc(file)) {
+        if (c != '\n' && c != EOF) {
+            line.push_back(static_cast<char>(c));
+            continue;
+        }
+
+        lineNumber++;
+
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        if (line.empty())
+            continue;
+
+        char *end = nullptr;
+        uint64_t checksum = strtoull(line.c_str(), &end, 16);
+
+        if (line.length() < 19 || end != line.c_str() + 16 || line.compare(16, 2, "  ") != 0) {
+            fclose(file);
+            throw ResourceError("Invalid line " + std::to_string(lineNumber) + " in " + manifestPath + ".");
+        }
+
+        expectedChecksums[line.substr(18)] = checksum;
+        line.clear();
+
+        if (c == EOF)
+            break;
+    }
+
+    fclose(file);
+    checksums = true;
+}
+
+// Write checksums as a manifest sorted by name, one "<16 hex digits>  <name>" line per file
+void writeChecksumManifest(const std::string &manifestPath, const std::unordered_map<std::string, uint64_t> &checksums)
+{
+#ifdef _WIN32
+    FILE *file = _wfopen(fs::path(manifestPath).c_str(), L"wb");
+#else
+    FILE *file = fopen(manifestPath.c_str(), "wb");
+#endif
+
+    if (file == nullptr)
+        throw ResourceError("Failed to open " + manifestPath + " for writing: " + strerror(errno));
+
+    std::vector<std::pair<std::string, uint64_t>> sortedChecksums(checksums.begin(), checksums.end());
+    std::sort(sortedChecksums.begin(), sortedChecksums.end());
+    bool success = true;
+
+    for (const auto &checksum : sortedChecksums)
+        success = fprintf(file, "%016" PRIx64 "  %s\n", checksum.second, checksum.first.c_str()) > 0 && success;
+
+    if (fclose(file) != 0 || !success)
+        throw ResourceError("Failed to write " + manifestPath + ": " + strerror(errno));
+}
+
+// Write the checksum of every verified file
+void VerifySink::writeManifest(const std::string &manifestPath) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    writeChecksumManifest(manifestPath, fileChecksums);
+}
+
+// Check a file's decompressed data
+void VerifySink::writeFile(const ResourceEntry &entry, const unsigned char *data)
+{
+    Checksum checksum;
+
+    if (checksums)
+        checksum.update(data, entry.size);
+
+    fileVerified(entry, entry.size, checksum.digest());
+}
+
+// Check a file passed in pieces
+std::unique_ptr<FileWriter> VerifySink::openFile(const ResourceEntry &entry)
+{
+    return std::unique_ptr<FileWriter>(new VerifyFileWriter(*this, entry));
+}
+
+// Record a file that failed to decompress and carry on with the rest
+bool VerifySink::fileFailed(const ResourceEntry &entry, const std::string &error)
+{
+    addFailure(entry.name, error);
+    return true;
+}
+
+// Record a file that failed verification
+void VerifySink::addFailure(const std::string &name, const std::string &error)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    failedFiles.push_back({name, error});
+}
+
+// Record a file's decompressed size and checksum, and compare them with the expected ones
+void VerifySink::fileVerified(const ResourceEntry &entry, uint64_t size, uint64_t checksum)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (size != entry.size) {
+        failedFiles.push_back({entry.name, "Decompressed to " + std::to_string(size) + " bytes instead of " + std::to_string(entry.size) + "."});
+        return;
+    }
+
+    verifiedBytes += size;
+
+    if (!checksums)
+        return;
+
+    fileChecksums[entry.name] = checksum;
+    auto expected = expectedChecksums.find(entry.name);
+
+    if (expected != expectedChecksums.end() && expected->second != checksum) {
+        char values[64];
+        snprintf(values, sizeof(values), "%016" PRIx64 " instead of %016" PRIx64, checksum, expected->second);
+        failedFiles.push_back({entry.name, std::string("Checksum is ") + values + "."});
+    }
+}
+
+// Names of the files in the loaded manifest
+std::vector<std::string> VerifySink::manifestEntries() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::string> names;
+
+    for (const auto &expected : expectedChecksums)
+        names.push_back(expected.first);
+
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+// Files that failed verification, sorted by name
+std::vector<VerifyFailure> VerifySink::failures() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<VerifyFailure> sortedFailures = failedFiles;
+
+    std::sort(sortedFailures.begin(), sortedFailures.end(), [](const VerifyFailure &a, const VerifyFailure &b) {
+        return a.name < b.name;
+    });
+
+    return sortedFailures;
+}
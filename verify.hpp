@@ -0,0 +1,66 @@
+#ifndef VERIFY_HPP
+#define VERIFY_HPP
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "sink.hpp"
+
+// Streaming XXH64 checksum of a file's data
+class Checksum {
+public:
+    Checksum();
+
+    void update(const unsigned char *data, size_t size);
+    uint64_t digest() const;
+private:
+    std::array<uint64_t, 4> lanes;
+    std::array<unsigned char, 32> pending;
+    size_t pendingSize = 0;
+    uint64_t totalSize = 0;
+};
+
+// File that failed verification, and why
+struct VerifyFailure {
+    std::string name;
+    std::string error;
+};
+
+// Decompresses files without writing them anywhere, checking that each one has exactly entry.size bytes
+//
+// With checksums enabled, the XXH64 checksum of every file is kept, to be written to a manifest or checked
+// against a known good one. Failures are recorded instead of stopping extraction, so every file gets checked.
+class VerifySink : public OutputSink {
+public:
+    explicit VerifySink(bool checksums);
+
+    void loadManifest(const std::string &manifestPath);
+    void writeManifest(const std::string &manifestPath) const;
+
+    void writeFile(const ResourceEntry &entry, const unsigned char *data) override;
+    std::unique_ptr<FileWriter> openFile(const ResourceEntry &entry) override;
+    bool fileFailed(const ResourceEntry &entry, const std::string &error) override;
+
+    void addFailure(const std::string &name, const std::string &error);
+    std::vector<std::string> manifestEntries() const;
+    std::vector<VerifyFailure> failures() const;
+    uint64_t bytesVerified() const { return verifiedBytes; }
+private:
+    class VerifyFileWriter;
+
+    bool checksums;
+    std::unordered_map<std::string, uint64_t> expectedChecksums;
+    std::unordered_map<std::string, uint64_t> fileChecksums;
+    std::vector<VerifyFailure> failedFiles;
+    std::atomic<uint64_t> verifiedBytes;
+    mutable std::mutex mutex;
+
+    void fileVerified(const ResourceEntry &entry, uint64_t size, uint64_t checksum);
+};
+
+void writeChecksumManifest(const std::string &manifestPath, const std::unordered_map<std::string, uint64_t> &checksums);
+
+#endif
@@ -0,0 +1,199 @@
+#include "vfs.hpp"
+
+// Get node key for the given path, skipping empty segments from leading, trailing or repeated slashes
+static std::string normalizePath(const std::string &path)
+{
+    std::string normalized;
+    normalized.reserve(path.length());
+
+    for (char c : path) {
+        if (c == '/' && (normalized.empty() || normalized.back() == '/'))
+            continue;
+
+        normalized.push_back(c);
+    }
+
+    if (!normalized.empty() && normalized.back() == '/')
+        normalized.pop_back();
+
+    return normalized;
+}
+
+// Split path into parent directory and name
+static std::pair<std::string, std::string> splitPath(const std::string &path)
+{
+    size_t separator = path.rfind('/');
+
+    if (separator == std::string::npos)
+        return {"", path};
+
+    return {path.substr(0, separator), path.substr(separator + 1)};
+}
+
+// ResourceFilesystem constructor
+ResourceFilesystem::ResourceFilesystem(size_t cacheBudget) : cacheBudget(cacheBudget)
+{
+    nodes[""];
+}
+
+// Get "<path> (N)" with the lowest N no file or directory has yet, for files in the way of a directory
+std::string ResourceFilesystem::freeSuffixPath(const std::string &path) const
+{
+    for (size_t suffix = 1;; suffix++) {
+        std::string suffixPath = path + " (" + std::to_string(suffix) + ")";
+
+        if (nodes.find(suffixPath) == nodes.end())
+            return suffixPath;
+    }
+}
+
+// Get directory node, creating it and its parents if needed
+ResourceFilesystem::VfsNode &ResourceFilesystem::addDirectory(const std::string &path)
+{
+    auto it = nodes.find(path);
+
+    if (it != nodes.end() && it->second.entry == nullptr)
+        return it->second;
+
+    // Move files in the way to "<name> (N)", like extraction does
+    if (it != nodes.end()) {
+        VfsNode file = std::move(it->second);
+        nodes.erase(it);
+
+        std::string filePath = freeSuffixPath(path);
+        nodes[splitPath(path).first].children.insert(splitPath(filePath).second);
+        nodes[filePath] = std::move(file);
+    }
+
+    auto [parent, name] = splitPath(path);
+    addDirectory(parent).children.insert(name);
+    return nodes[path];
+}
+
+// Add all files in the archive to the tree, replacing files with the same path from earlier archives
+void ResourceFilesystem::addArchive(const ResourceArchive &archive)
+{
+    for (const auto &entry : archive.entries) {
+        std::string path = normalizePath(entry.name);
+
+        if (path.empty())
+            continue;
+
+        auto [parent, name] = splitPath(path);
+        VfsNode &parentNode = addDirectory(parent);
+
+        auto it = nodes.find(path);
+
+        if (it != nodes.end() && it->second.entry == nullptr) {
+            path = freeSuffixPath(path);
+            name = splitPath(path).second;
+        }
+
+        parentNode.children.insert(name);
+        VfsNode &node = nodes[path];
+        node.archive = &archive;
+        node.entry = &entry;
+    }
+}
+
+// Find node for the given path
+const ResourceFilesystem::VfsNode *ResourceFilesystem::findNode(const std::string &path) const
+{
+    auto it = nodes.find(normalizePath(path));
+    return it == nodes.end() ? nullptr : &it->second;
+}
+
+// Get file or directory metadata from the index, returns false if it doesn't exist
+bool ResourceFilesystem::stat(const std::string &path, VfsStat &stat) const
+{
+    const VfsNode *node = findNode(path);
+
+    if (node == nullptr)
+        return false;
+
+    stat.isDirectory = node->entry == nullptr;
+    stat.size = node->entry == nullptr ? 0 : node->entry->size;
+    return true;
+}
+
+// List directory contents from the index, returns false if it isn't a directory
+bool ResourceFilesystem::listDirectory(const std::string &path, std::vector<std::pair<std::string, VfsStat>> &children) const
+{
+    const VfsNode *node = findNode(path);
+
+    if (node == nullptr || node->entry != nullptr)
+        return false;
+
+    std::string directory = normalizePath(path);
+
+    if (!directory.empty())
+        directory.push_back('/');
+
+    children.clear();
+    children.reserve(node->children.size());
+
+    for (const auto &name : node->children) {
+        VfsStat childStat;
+        stat(directory + name, childStat);
+        children.emplace_back(name, childStat);
+    }
+
+    return true;
+}
+
+// Open file, decompressing it if it isn't cached yet
+VfsFile ResourceFilesystem::open(const std::string &path)
+{
+    const VfsNode *node = findNode(path);
+
+    if (node == nullptr || node->entry == nullptr)
+        throw ResourceError(path + " is not a file.");
+
+    const ResourceEntry *entry = node->entry;
+
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto it = cacheIndex.find(entry);
+
+        if (it != cacheIndex.end()) {
+            cache.splice(cache.begin(), cache, it->second);
+            return {it->second->buffer, it->second->buffer.get(), entry->size};
+        }
+    }
+
+    // Stored files are served straight from the mapped archive
+    std::unique_ptr<unsigned char[]> decBytes;
+    const unsigned char *data = node->archive->readEntry(*entry, decBytes);
+
+    if (decBytes == nullptr)
+        return {nullptr, data, entry->size};
+
+    std::shared_ptr<unsigned char[]> buffer(std::move(decBytes));
+
+    // Files larger than the budget are not cached
+    if (entry->size > cacheBudget)
+        return {buffer, buffer.get(), entry->size};
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+    if (cacheIndex.find(entry) == cacheIndex.end()) {
+        while (cacheSize + entry->size > cacheBudget) {
+            cacheSize -= cache.back().entry->size;
+            cacheIndex.erase(cache.back().entry);
+            cache.pop_back();
+        }
+
+        cache.push_front({entry, buffer});
+        cacheIndex[entry] = cache.begin();
+        cacheSize += entry->size;
+    }
+
+    return {buffer, buffer.get(), entry->size};
+}
+
+// Get the number of decompressed bytes currently cached
+size_t ResourceFilesystem::cachedBytes()
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    return cacheSize;
+}
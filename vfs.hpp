@@ -0,0 +1,63 @@
+#ifndef VFS_HPP
+#define VFS_HPP
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "archive.hpp"
+
+// Metadata of a file or directory in the virtual filesystem
+struct VfsStat {
+    bool isDirectory;
+    uint64_t size;
+};
+
+// Opened file, keeps its decompressed data alive while in use
+struct VfsFile {
+    std::shared_ptr<unsigned char[]> buffer;
+    const unsigned char *data;
+    uint64_t size;
+};
+
+// Read-only virtual filesystem over the directory trees of one or more archives,
+// decompressing files on first open and caching them up to the given memory budget
+class ResourceFilesystem {
+public:
+    explicit ResourceFilesystem(size_t cacheBudget);
+
+    void addArchive(const ResourceArchive &archive);
+    bool stat(const std::string &path, VfsStat &stat) const;
+    bool listDirectory(const std::string &path, std::vector<std::pair<std::string, VfsStat>> &children) const;
+    VfsFile open(const std::string &path);
+    size_t cachedBytes();
+private:
+    // File or directory, directories have no entry
+    struct VfsNode {
+        const ResourceArchive *archive = nullptr;
+        const ResourceEntry *entry = nullptr;
+        std::set<std::string> children;
+    };
+
+    // Decompressed file in the LRU cache
+    struct CacheItem {
+        const ResourceEntry *entry;
+        std::shared_ptr<unsigned char[]> buffer;
+    };
+
+    std::unordered_map<std::string, VfsNode> nodes;
+    size_t cacheBudget;
+    size_t cacheSize = 0;
+    std::list<CacheItem> cache;
+    std::unordered_map<const ResourceEntry*, std::list<CacheItem>::iterator> cacheIndex;
+    std::mutex cacheMutex;
+
+    std::string freeSuffixPath(const std::string &path) const;
+    VfsNode &addDirectory(const std::string &path);
+    const VfsNode *findNode(const std::string &path) const;
+};
+
+#endif
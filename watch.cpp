@@ -0,0 +1,499 @@
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <vector>
+#include "watch.hpp"
+#include "sink.hpp"
+#include "verify.hpp"
+
+#ifndef _WIN32
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+// Longest time to block waiting for events, so stop requests are noticed
+#define WATCH_POLL_MS 500
+
+#ifdef _WIN32
+// inotify is not available on Windows builds
+ArchiveWatcher::ArchiveWatcher(const std::string&, const std::string&, const ExtractOptions &options, unsigned int debounceMilliseconds, bool checksums, std::ostream &log)
+    : options(options), debounce(debounceMilliseconds), checksums(checksums), log(log), inotifyDescriptor(-1), stopping(false)
+{
+    throw ResourceError("Watching archives for changes is not supported on Windows.");
+}
+
+ArchiveWatcher::~ArchiveWatcher() = default;
+void ArchiveWatcher::run() {}
+void ArchiveWatcher::stop() {}
+void ArchiveWatcher::watchDirectory(const fs::path&) {}
+void ArchiveWatcher::readEvents() {}
+void ArchiveWatcher::updateArchive(const fs::path&) {}
+#else
+// Whether the file is an archive that should be mirrored
+static bool isArchive(const fs::path &path)
+{
+    return path.extension() == ".resources" || path.extension() == ".wad7";
+}
+
+// Whether two entries are stored at the same place with the same sizes, and with checksums, hold the same data
+static bool sameEntry(const WatchedEntry &a, const WatchedEntry &b, bool checksums)
+{
+    return a.offset == b.offset && a.size == b.size && a.zSize == b.zSize && a.compressionMode == b.compressionMode
+        && (!checksums || a.checksum == b.checksum);
+}
+
+// Set the XXH64 checksum of the given entries' stored data on up to threadCount threads, without decompressing it
+static void checksumEntries(const ResourceArchive &archive, const std::vector<const ResourceEntry*> &entries, std::vector<WatchedEntry*> &watchedEntries, unsigned int threadCount)
+{
+    std::atomic<size_t> nextEntry(0);
+
+    auto checksumWorker = [&]() {
+        for (size_t i = nextEntry++; i < entries.size(); i = nextEntry++) {
+            Checksum checksum;
+            checksum.update(archive.memoryMappedFile->memp + entries[i]->offset, entries[i]->zSize);
+            watchedEntries[i]->checksum = checksum.digest();
+        }
+    };
+
+    std::vector<std::thread> threads;
+
+    for (unsigned int i = 1; i < threadCount; i++)
+        threads.emplace_back(checksumWorker);
+
+    checksumWorker();
+
+    for (auto &thread : threads)
+        thread.join();
+}
+
+// Sort and merge byte ranges of the archive, so overlapsRanges can search them
+static void mergeRanges(std::vector<std::pair<uint64_t, uint64_t>> &ranges)
+{
+    std::sort(ranges.begin(), ranges.end());
+    size_t merged = 0;
+
+    for (size_t i = 0; i < ranges.size(); i++) {
+        if (merged != 0 && ranges[i].first <= ranges[merged - 1].second)
+            ranges[merged - 1].second = std::max(ranges[merged - 1].second, ranges[i].second);
+        else
+            ranges[merged++] = ranges[i];
+    }
+
+    ranges.resize(merged);
+}
+
+// Whether the bytes from begin to end overlap any of the merged ranges
+static bool overlapsRanges(const std::vector<std::pair<uint64_t, uint64_t>> &ranges, uint64_t begin, uint64_t end)
+{
+    auto range = std::upper_bound(ranges.begin(), ranges.end(), begin, [](uint64_t position, const std::pair<uint64_t, uint64_t> &range) {
+        return position < range.second;
+    });
+
+    return range != ranges.end() && range->first < end;
+}
+
+// Append little endian integer to a byte vector
+static void appendLE(std::vector<unsigned char> &bytes, uint64_t value, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        bytes.push_back(static_cast<unsigned char>(value >> (i * 8)));
+}
+
+// Read little endian integer at the position, moving past it
+static bool readLE(const std::vector<unsigned char> &bytes, size_t &position, uint64_t &value, size_t size)
+{
+    if (bytes.size() - position < size)
+        return false;
+
+    value = 0;
+
+    for (size_t i = 0; i < size; i++)
+        value |= static_cast<uint64_t>(bytes[position + i]) << (i * 8);
+
+    position += size;
+    return true;
+}
+
+// Load an index saved by saveWatchIndex, returns false if there's none, it's invalid, or it was saved with
+// checksums set differently
+static bool loadWatchIndex(const fs::path &indexPath, bool checksums, std::unordered_map<std::string, WatchedEntry> &index)
+{
+    std::ifstream file(indexPath, std::ios::binary);
+    std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    size_t position = 4;
+    uint64_t savedChecksums, entryCount;
+
+    if (bytes.size() < 4 || memcmp(bytes.data(), WATCH_INDEX_MAGIC, 4) != 0
+    || !readLE(bytes, position, savedChecksums, 4) || savedChecksums != (checksums ? 1 : 0) || !readLE(bytes, position, entryCount, 4))
+        return false;
+
+    for (uint64_t i = 0; i < entryCount; i++) {
+        uint64_t nameLength;
+        WatchedEntry entry;
+
+        if (!readLE(bytes, position, nameLength, 4) || bytes.size() - position < nameLength)
+            return false;
+
+        std::string name(reinterpret_cast<const char*>(bytes.data() + position), nameLength);
+        position += nameLength;
+
+        if (!readLE(bytes, position, entry.offset, 8) || !readLE(bytes, position, entry.size, 8) || !readLE(bytes, position, entry.zSize, 8)
+        || !readLE(bytes, position, entry.compressionMode, 8) || !readLE(bytes, position, entry.checksum, 8))
+            return false;
+
+        index[name] = entry;
+    }
+
+    return position == bytes.size();
+}
+
+// Save an archive's index next to its mirror, replacing the previous one at once
+static void saveWatchIndex(const fs::path &indexPath, bool checksums, const std::unordered_map<std::string, WatchedEntry> &index)
+{
+    std::vector<unsigned char> bytes(WATCH_INDEX_MAGIC, WATCH_INDEX_MAGIC + 4);
+    appendLE(bytes, checksums ? 1 : 0, 4);
+    appendLE(bytes, index.size(), 4);
+
+    for (const auto &entry : index) {
+        appendLE(bytes, entry.first.length(), 4);
+        bytes.insert(bytes.end(), entry.first.begin(), entry.first.end());
+        appendLE(bytes, entry.second.offset, 8);
+        appendLE(bytes, entry.second.size, 8);
+        appendLE(bytes, entry.second.zSize, 8);
+        appendLE(bytes, entry.second.compressionMode, 8);
+        appendLE(bytes, entry.second.checksum, 8);
+    }
+
+    fs::path tempPath = indexPath;
+    tempPath += ".part";
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    file.close();
+
+    std::error_code ec;
+
+    if (!file)
+        throw ResourceError("Failed to write " + tempPath.string());
+
+    fs::rename(tempPath, indexPath, ec);
+
+    if (ec.value() != 0)
+        throw ResourceError("Failed to write " + indexPath.string() + ": " + ec.message());
+}
+
+// ArchiveWatcher constructor, starts watching every directory under the game path
+ArchiveWatcher::ArchiveWatcher(const std::string &gamePath, const std::string &outPath, const ExtractOptions &options, unsigned int debounceMilliseconds, bool checksums, std::ostream &log)
+    : gamePath(fs::absolute(gamePath).lexically_normal()), outPath(fs::absolute(outPath).lexically_normal()), options(options), debounce(debounceMilliseconds), checksums(checksums), log(log), stopping(false)
+{
+    if (!this->outPath.has_filename())
+        this->outPath = this->outPath.parent_path();
+
+    if (!fs::is_directory(this->gamePath))
+        throw ResourceError(gamePath + " is not a directory.");
+
+    inotifyDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (inotifyDescriptor == -1)
+        throw ResourceError(std::string("Failed to start watching for changes: ") + strerror(errno));
+
+    // Progress can't be restarted for every update
+    this->options.progress = nullptr;
+
+    try {
+        watchDirectory(this->gamePath);
+    }
+    catch (...) {
+        close(inotifyDescriptor);
+        throw;
+    }
+}
+
+// ArchiveWatcher destructor
+ArchiveWatcher::~ArchiveWatcher()
+{
+    close(inotifyDescriptor);
+}
+
+// Watch a directory and the ones under it, queueing the archives found in them for an update
+// The out directory is left out, in case it's inside the watched one
+void ArchiveWatcher::watchDirectory(const fs::path &directoryPath)
+{
+    std::error_code ec;
+
+    if (directoryPath == outPath)
+        return;
+
+    // Archives are opened for writing to be mapped, so closing them after writes can't be told apart from reading them
+    int watchDescriptor = inotify_add_watch(inotifyDescriptor, directoryPath.c_str(), IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | IN_ONLYDIR);
+
+    if (watchDescriptor == -1)
+        throw ResourceError("Failed to watch " + directoryPath.string() + ": " + strerror(errno));
+
+    watchedDirectories[watchDescriptor] = directoryPath;
+    auto now = std::chrono::steady_clock::now();
+
+    for (fs::directory_iterator it(directoryPath, ec), end; it != end && !ec; it.increment(ec)) {
+        if (it->is_directory(ec))
+            watchDirectory(it->path());
+        else if (isArchive(it->path()) && it->is_regular_file(ec))
+            pendingArchives[it->path().string()] = now - debounce;
+    }
+
+    if (ec.value() != 0)
+        throw ResourceError("Failed to read " + directoryPath.string() + ": " + ec.message());
+}
+
+// Handle the queued inotify events, restarting the debounce time of every archive being written
+void ArchiveWatcher::readEvents()
+{
+    alignas(inotify_event) char buffer[65536];
+    auto now = std::chrono::steady_clock::now();
+
+    while (true) {
+        ssize_t length = read(inotifyDescriptor, buffer, sizeof(buffer));
+
+        if (length == -1 && errno == EINTR)
+            continue;
+
+        if (length <= 0)
+            break;
+
+        for (ssize_t position = 0; position < length;) {
+            const auto *event = reinterpret_cast<const inotify_event*>(buffer + position);
+            position += sizeof(inotify_event) + event->len;
+
+            // Events were dropped, check every archive again
+            if ((event->mask & IN_Q_OVERFLOW) != 0) {
+                for (const auto &index : indexes)
+                    pendingArchives[index.first] = now;
+
+                continue;
+            }
+
+            auto directory = watchedDirectories.find(event->wd);
+
+            if ((event->mask & IN_IGNORED) != 0) {
+                if (directory != watchedDirectories.end())
+                    watchedDirectories.erase(directory);
+
+                continue;
+            }
+
+            if (directory == watchedDirectories.end() || event->len == 0)
+                continue;
+
+            fs::path path = directory->second / event->name;
+
+            if ((event->mask & IN_ISDIR) != 0) {
+                if ((event->mask & (IN_CREATE | IN_MOVED_TO)) != 0) {
+                    try {
+                        watchDirectory(path);
+                    }
+                    catch (const ResourceError &e) {
+                        log << "ERROR: " << e.what() << std::endl;
+                    }
+                }
+
+                continue;
+            }
+
+            if (!isArchive(path))
+                continue;
+
+            // Removed archives keep their mirror, but will be checked against it again if they come back
+            if ((event->mask & (IN_DELETE | IN_MOVED_FROM)) != 0) {
+                pendingArchives.erase(path.string());
+                indexes.erase(path.string());
+                continue;
+            }
+
+            pendingArchives[path.string()] = now;
+        }
+    }
+}
+
+// Parse an archive's index again and extract the entries that changed since the last time
+void ArchiveWatcher::updateArchive(const fs::path &archivePath)
+{
+    auto begin = std::chrono::steady_clock::now();
+    fs::path relativePath = archivePath.lexically_relative(gamePath);
+    std::string mirrorPath = (outPath / relativePath).replace_extension().string() + fs::path::preferred_separator;
+    fs::path indexPath = (outPath / relativePath).replace_extension(WATCH_INDEX_EXTENSION);
+
+    std::unique_ptr<ResourceArchive> archive;
+
+    try {
+        archive.reset(new ResourceArchive(archivePath));
+    }
+    catch (const ResourceError &e) {
+        log << "ERROR: " << e.what() << std::endl;
+        return;
+    }
+
+    // On startup, diff against the index saved with the mirror instead
+    auto previousIndex = indexes.find(archivePath.string());
+    bool startup = previousIndex == indexes.end();
+
+    if (startup) {
+        std::unordered_map<std::string, WatchedEntry> savedIndex;
+
+        if (loadWatchIndex(indexPath, checksums, savedIndex))
+            previousIndex = indexes.emplace(archivePath.string(), std::move(savedIndex)).first;
+    }
+
+    bool hasPreviousIndex = previousIndex != indexes.end();
+
+    // Every entry is indexed, as the data of filtered out ones may overlap the selected ones
+    std::vector<const ResourceEntry*> entries = selectEntries(*archive, options);
+    std::unordered_map<std::string, WatchedEntry> index;
+
+    for (const auto &entry : archive->entries)
+        index[entry.name] = {entry.offset, entry.size, entry.zSize, entry.compressionMode, 0};
+
+    if (checksums) {
+        std::vector<WatchedEntry*> watchedEntries;
+
+        for (const auto *entry : entries)
+            watchedEntries.push_back(&index[entry->name]);
+
+        checksumEntries(*archive, entries, watchedEntries, options.threadCount);
+    }
+
+    // The data written for new, moved or resized entries may overwrite entries that are otherwise unchanged
+    std::vector<std::pair<uint64_t, uint64_t>> writtenRanges;
+    bool indexChanged = !hasPreviousIndex || previousIndex->second.size() != index.size();
+
+    if (hasPreviousIndex) {
+        for (const auto &entry : archive->entries) {
+            auto previousEntry = previousIndex->second.find(entry.name);
+
+            if (previousEntry == previousIndex->second.end() || !sameEntry(previousEntry->second, index[entry.name], false)) {
+                writtenRanges.push_back({entry.offset, entry.offset + entry.zSize});
+                indexChanged = true;
+            }
+        }
+
+        mergeRanges(writtenRanges);
+    }
+
+    std::vector<const ResourceEntry*> changedEntries;
+    std::error_code ec;
+    fs::file_time_type archiveTime = fs::last_write_time(archivePath, ec);
+
+    for (const auto *entry : entries) {
+        bool changed = false;
+
+        if (hasPreviousIndex) {
+            auto previousEntry = previousIndex->second.find(entry->name);
+
+            changed = previousEntry == previousIndex->second.end() || !sameEntry(previousEntry->second, index[entry->name], checksums)
+                || overlapsRanges(writtenRanges, entry->offset, entry->offset + entry->zSize);
+        }
+
+        // On startup, also compare with what's in the mirror, which may have been changed since the index was saved
+        if (!changed && startup) {
+            fs::path mirroredPath = fs::path(mirrorPath + entry->name).make_preferred();
+            uint64_t mirroredSize = fs::file_size(mirroredPath, ec);
+            changed = ec.value() != 0 || mirroredSize != entry->size;
+
+            // Without an index, a mirrored file older than the archive may be from before it was patched
+            if (!changed && !hasPreviousIndex)
+                changed = fs::last_write_time(mirroredPath, ec) < archiveTime || ec.value() != 0;
+        }
+
+        if (changed)
+            changedEntries.push_back(entry);
+    }
+
+    size_t removedFiles = 0;
+
+    if (hasPreviousIndex) {
+        for (const auto &previousEntry : previousIndex->second) {
+            if (index.find(previousEntry.first) == index.end() && fs::remove(fs::path(mirrorPath + previousEntry.first).make_preferred(), ec))
+                removedFiles++;
+        }
+    }
+
+    // Keep the previous index on failure, so the same entries are extracted again on the next update
+    if (!changedEntries.empty() || removedFiles != 0) {
+        try {
+            fs::create_directories(mirrorPath, ec);
+
+            if (ec.value() != 0)
+                throw ResourceError("Failed to create " + mirrorPath + ": " + ec.message());
+
+            DirectorySink sink(mirrorPath);
+            extractEntries(*archive, changedEntries, sink, options);
+        }
+        catch (const ResourceError &e) {
+            log << "ERROR: Failed to update " << relativePath.string() << ": " << e.what() << std::endl;
+            return;
+        }
+    }
+
+    indexes[archivePath.string()] = std::move(index);
+
+    if (indexChanged || !changedEntries.empty()) {
+        try {
+            fs::create_directories(indexPath.parent_path(), ec);
+            saveWatchIndex(indexPath, checksums, indexes[archivePath.string()]);
+        }
+        catch (const ResourceError &e) {
+            log << "ERROR: " << e.what() << std::endl;
+        }
+    }
+
+    if (changedEntries.empty() && removedFiles == 0)
+        return;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    log << "Updated " << relativePath.string() << ": " << changedEntries.size() << " files extracted, " << removedFiles << " removed in " << seconds << " seconds." << std::endl;
+}
+
+// Update the mirror of every archive that stopped changing, until stopped
+void ArchiveWatcher::run()
+{
+    while (!stopping) {
+        // Sleep until the next archive is due for an update, or an event comes in
+        auto now = std::chrono::steady_clock::now();
+        auto timeout = std::chrono::milliseconds(WATCH_POLL_MS);
+
+        for (const auto &pending : pendingArchives)
+            timeout = std::min(timeout, std::chrono::duration_cast<std::chrono::milliseconds>(pending.second + debounce - now));
+
+        pollfd descriptor = {inotifyDescriptor, POLLIN, 0};
+
+        if (poll(&descriptor, 1, static_cast<int>(std::max<int64_t>(timeout.count(), 0))) > 0)
+            readEvents();
+
+        // Archives written to since are left for the next round
+        now = std::chrono::steady_clock::now();
+        std::vector<std::string> dueArchives;
+
+        for (const auto &pending : pendingArchives) {
+            if (now - pending.second >= debounce)
+                dueArchives.push_back(pending.first);
+        }
+
+        std::sort(dueArchives.begin(), dueArchives.end());
+
+        for (const auto &archivePath : dueArchives) {
+            if (stopping)
+                break;
+
+            pendingArchives.erase(archivePath);
+            updateArchive(archivePath);
+        }
+    }
+}
+
+// Stop watching after the current update
+void ArchiveWatcher::stop()
+{
+    stopping = true;
+}
+#endif
@@ -0,0 +1,66 @@
+#ifndef WATCH_HPP
+#define WATCH_HPP
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include "extract.hpp"
+
+// Time to wait after the last write to an archive before updating its mirror
+#define WATCH_DEBOUNCE_MS 2000
+
+// Index saved next to each archive's mirror, so it's diffed against what was mirrored when watching starts again
+// Magic, checksums flag and entry count, then each entry's name length, name, offset, sizes, mode and checksum
+#define WATCH_INDEX_MAGIC "ERW1"
+#define WATCH_INDEX_EXTENSION ".watchindex"
+
+// What's kept of each entry between updates, its checksum is only set if checksums are compared
+struct WatchedEntry {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t zSize;
+    uint64_t compressionMode;
+    uint64_t checksum;
+};
+
+// Keeps an extracted mirror of every archive under a directory up to date as they're patched
+//
+// Each archive is mirrored into the out directory, under its path relative to the watched one without the
+// extension. Archives are watched for writes with inotify, and once one stops changing for the debounce time its
+// index is parsed again and diffed against the previous one: entries that are new, moved or resized, or whose data
+// overlaps the data written for those, are extracted, and the files of entries that were removed are deleted.
+// With checksums, the stored data of every entry is also hashed to catch files rewritten in place with the same
+// sizes. The index is saved next to the mirror after each update, and diffed against on startup as well, along
+// with replacing mirrored files that are missing or have the wrong size. Without a saved index, mirrored files
+// older than the archive are replaced too.
+class ArchiveWatcher {
+public:
+    ArchiveWatcher(const std::string &gamePath, const std::string &outPath, const ExtractOptions &options, unsigned int debounceMilliseconds, bool checksums, std::ostream &log);
+    ~ArchiveWatcher();
+
+    ArchiveWatcher(const ArchiveWatcher&) = delete;
+    ArchiveWatcher &operator=(const ArchiveWatcher&) = delete;
+
+    void run();
+    void stop();
+private:
+    fs::path gamePath;
+    fs::path outPath;
+    ExtractOptions options;
+    std::chrono::milliseconds debounce;
+    bool checksums;
+    std::ostream &log;
+    int inotifyDescriptor;
+    std::atomic<bool> stopping;
+    std::unordered_map<int, fs::path> watchedDirectories;
+    std::unordered_map<std::string, std::unordered_map<std::string, WatchedEntry>> indexes;
+    std::unordered_map<std::string, std::chrono::steady_clock::time_point> pendingArchives;
+
+    void watchDirectory(const fs::path &directoryPath);
+    void readEvents();
+    void updateArchive(const fs::path &archivePath);
+};
+
+#endif